@@ -0,0 +1,49 @@
+#include "AdaptiveRefinement.hpp"
+#include <algorithm>
+#include <numeric>
+
+std::vector<uint32_t> markCuboids(std::span<const double> errors, const AdaptiveOptions& options)
+{
+    std::vector<uint32_t> order;
+    order.reserve(errors.size());
+    for (uint32_t c = 0; c < errors.size(); c++) {
+        if (errors[c] > 0.0) order.push_back(c);
+    }
+    // Largest errors first, ties by id so the marking does not depend on the sort
+    const auto larger = [&](uint32_t a, uint32_t b) { return errors[a] != errors[b] ? errors[a] > errors[b] : a < b; };
+    switch (options.strategy)
+    {
+    case MarkingStrategy::maximum: {
+        const double max_error = order.empty() ? 0.0 : *std::max_element(errors.begin(), errors.end());
+        std::erase_if(order, [&](uint32_t c) { return errors[c] < options.theta * max_error; });
+        std::sort(order.begin(), order.end(), larger);
+        break;
+    }
+    case MarkingStrategy::dorfler: {
+        std::sort(order.begin(), order.end(), larger);
+        const double total = std::accumulate(errors.begin(), errors.end(), 0.0);
+        double marked_error = 0.0;
+        size_t marked = 0;
+        while (marked < order.size() && marked_error < options.theta * total) marked_error += errors[order[marked++]];
+        order.resize(marked);
+        break;
+    }
+    case MarkingStrategy::fixed_count: {
+        const size_t marked = std::min(options.count, order.size());
+        std::partial_sort(order.begin(), order.begin() + static_cast<std::ptrdiff_t>(marked), order.end(), larger);
+        order.resize(marked);
+        break;
+    }
+    }
+    return order;
+}
+
+SplitRequest bisectLongestSide(const Mesh& mesh, uint32_t cuboid)
+{
+    const Box& box = mesh.getBoxes()[cuboid];
+    const Vertex size = box.max - box.min;
+    Axis axis = Axis::x;
+    if (size.y > axisCoord(size, axis)) axis = Axis::y;
+    if (size.z > axisCoord(size, axis)) axis = Axis::z;
+    return { cuboid, axis, axisCoord(box.center(), axis) };
+}
@@ -0,0 +1,121 @@
+#ifndef _ADAPTIVEREFINEMENT_HPP
+#define _ADAPTIVEREFINEMENT_HPP
+#include "Mesh.hpp"
+#include "Parallel.hpp"
+#include <numeric>
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+/*
+* Strategies to mark the cuboids to refine from their error indicators
+*/
+enum class MarkingStrategy
+{
+    // Every cuboid with an error of at least theta times the largest error
+    maximum,
+    // Dörfler (bulk) marking: the fewest cuboids with the largest errors that together have at least theta times the total error
+    dorfler,
+    // The count cuboids with the largest errors
+    fixed_count
+};
+
+struct AdaptiveOptions
+{
+    MarkingStrategy strategy = MarkingStrategy::dorfler;
+    double theta = 0.5;
+    size_t count = 1;
+    // Stop when the total error is at most tolerance
+    double tolerance = 0.0;
+    // Stop when the mesh has this many cuboids, the last batch is cut off at the budget
+    size_t max_cuboids = 1 << 20;
+    size_t max_iterations = 100;
+    // Balance the mesh with Mesh::Balance(max_ratio) after every batch, 0 disables it. Balancing may exceed the element budget
+    float max_ratio = 0.0f;
+    unsigned num_threads = 0;
+};
+
+enum class AdaptiveStop
+{
+    tolerance,
+    budget,
+    iterations,
+    // No cuboid was marked or none of the marked cuboids could be split
+    stalled
+};
+
+struct AdaptiveResult
+{
+    AdaptiveStop reason;
+    size_t iterations = 0;
+    // Total error of the final mesh
+    double error = 0.0;
+};
+
+/*
+* Mark cuboids for refinement, returns their ids ordered by decreasing error. Cuboids without error are never marked.
+*/
+std::vector<uint32_t> markCuboids(std::span<const double> errors, const AdaptiveOptions& options);
+
+/*
+* The split of a marked cuboid: halve it along its longest side, so anisotropic cuboids become more isotropic
+*/
+SplitRequest bisectLongestSide(const Mesh& mesh, uint32_t cuboid);
+
+/*
+* Refine a mesh adaptively: evaluate indicator(mesh, cuboid) for every cuboid, mark cuboids, bisect them in one batch and repeat.
+* With max_ratio set the mesh is balanced after every batch, the cuboids split for the balance are evaluated again as well.
+* The indicator is evaluated in parallel and must be safe to call concurrently, it can use every const member of the mesh
+* as the mesh is prepared for concurrent reads first. Splits keep the ids of all other cuboids,
+* so only the split cuboids and the new cuboids are evaluated again in the next iteration.
+*/
+template<typename Indicator>
+AdaptiveResult refineAdaptively(Mesh& mesh, Indicator&& indicator, const AdaptiveOptions& options = {})
+{
+    std::vector<double> errors;
+    std::vector<uint32_t> changed(mesh.getCuboids().size());
+    std::iota(changed.begin(), changed.end(), 0);
+    AdaptiveResult result;
+    for (;; result.iterations++) {
+        errors.resize(mesh.getCuboids().size());
+        mesh.prepareForConcurrentReads();
+        parallelFor(changed.size(), [&](size_t i) { errors[changed[i]] = indicator(static_cast<const Mesh&>(mesh), changed[i]); }, options.num_threads, 64);
+        result.error = 0.0;
+        for (const double error : errors) result.error += error;
+        if (result.error <= options.tolerance) {
+            result.reason = AdaptiveStop::tolerance;
+            return result;
+        }
+        if (mesh.getCuboids().size() >= options.max_cuboids) {
+            result.reason = AdaptiveStop::budget;
+            return result;
+        }
+        if (result.iterations == options.max_iterations) {
+            result.reason = AdaptiveStop::iterations;
+            return result;
+        }
+        auto marked = markCuboids(errors, options);
+        // Every split adds one cuboid, keep the largest errors within the budget
+        marked.resize(std::min(marked.size(), options.max_cuboids - mesh.getCuboids().size()));
+        std::vector<SplitRequest> requests(marked.size());
+        for (size_t i = 0; i < marked.size(); i++) requests[i] = bisectLongestSide(mesh, marked[i]);
+        const auto new_ids = mesh.SplitParallel(requests, options.num_threads);
+        changed.clear();
+        for (size_t i = 0; i < marked.size(); i++) {
+            if (new_ids[i] == static_cast<uint32_t>(-1)) continue;
+            changed.push_back(marked[i]);
+            changed.push_back(new_ids[i]);
+        }
+        if (options.max_ratio > 0.0f && !changed.empty()) {
+            const auto balanced = result.iterations == 0 ? mesh.Balance(options.max_ratio) : mesh.Balance(options.max_ratio, changed);
+            changed.insert(changed.end(), balanced.begin(), balanced.end());
+            std::sort(changed.begin(), changed.end());
+            changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+        }
+        if (changed.empty()) {
+            result.reason = AdaptiveStop::stalled;
+            return result;
+        }
+    }
+}
+#endif
@@ -0,0 +1,37 @@
+#include "DualGraph.hpp"
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+bool DualGraph::adjacent(uint32_t c1, uint32_t c2) const
+{
+    const auto row = neighbours(c1);
+    return std::binary_search(row.begin(), row.end(), c2);
+}
+
+float DualGraph::sharedArea(uint32_t c1, uint32_t c2) const
+{
+    const auto row = neighbours(c1);
+    const auto it = std::lower_bound(row.begin(), row.end(), c2);
+    if (it == row.end() || *it != c2) return 0.0f;
+    return areas[offsets[c1] + static_cast<size_t>(std::distance(row.begin(), it))];
+}
+
+void DualGraph::writeMetis(const std::string& filename, double area_scale) const
+{
+    std::ofstream out(filename);
+    if (out.fail()) throw std::runtime_error("failed to open " + filename);
+    // Header: number of vertices, number of edges and format 001 for edge weights only, METIS numbers vertices from 1
+    out << size() << ' ' << numEdges() << " 001\n";
+    for (uint32_t c = 0; c < size(); c++) {
+        const auto row = neighbours(c);
+        const auto row_weights = weights(c);
+        for (size_t i = 0; i < row.size(); i++) {
+            const auto weight = std::max<long long>(1, std::llround(static_cast<double>(row_weights[i]) * area_scale));
+            out << (i == 0 ? "" : " ") << row[i] + 1 << ' ' << weight;
+        }
+        out << '\n';
+    }
+    if (out.fail()) throw std::runtime_error("failed to write " + filename);
+}
@@ -0,0 +1,72 @@
+#ifndef _DUALGRAPH_HPP
+#define _DUALGRAPH_HPP
+#include "Parallel.hpp"
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+/*  DualGraph class, the face adjacency graph of the cuboids in compressed rows (CSR)
+*   Two cuboids are adjacent if they share part of a face, the edge is weighted by the area they share.
+*   The neighbours of every cuboid are sorted, so adjacency is tested with a binary search.
+*/
+class DualGraph
+{
+private:
+    // The neighbours of cuboid c are neighbours[offsets[c]] up to neighbours[offsets[c + 1]], areas holds the shared face areas
+    std::vector<uint32_t> offsets = { 0 };
+    std::vector<uint32_t> neighbour_ids;
+    std::vector<float> areas;
+public:
+    size_t size() const { return offsets.size() - 1; }
+    // Number of edges, every adjacent pair counted once
+    size_t numEdges() const { return neighbour_ids.size() / 2; }
+    size_t degree(uint32_t c) const { return offsets[c + 1] - offsets[c]; }
+    std::span<const uint32_t> neighbours(uint32_t c) const { return { neighbour_ids.data() + offsets[c], neighbour_ids.data() + offsets[c + 1] }; }
+    // The shared face areas, in the order of neighbours(c)
+    std::span<const float> weights(uint32_t c) const { return { areas.data() + offsets[c], areas.data() + offsets[c + 1] }; }
+    bool adjacent(uint32_t c1, uint32_t c2) const;
+    // Area shared by two cuboids, 0 if they are not adjacent
+    float sharedArea(uint32_t c1, uint32_t c2) const;
+    const std::vector<uint32_t>& getOffsets() const { return offsets; }
+    const std::vector<uint32_t>& getNeighbours() const { return neighbour_ids; }
+    const std::vector<float>& getWeights() const { return areas; }
+    /*
+    * Build the graph of num_cuboids cuboids in parallel, neighbours(c, out) appends the (neighbour, area) pairs of c to out.
+    * A neighbour may be reported more than once, only its first area is kept.
+    */
+    template<typename NeighbourFn>
+    void build(size_t num_cuboids, NeighbourFn&& neighbours, unsigned num_threads = 0);
+    /*
+    * Write the graph in the METIS graph file format, with the areas scaled by area_scale and rounded to positive integer edge weights.
+    * Throws a std::runtime_error if the file cannot be written.
+    */
+    void writeMetis(const std::string& filename, double area_scale = 1 << 20) const;
+};
+
+template<typename NeighbourFn>
+void DualGraph::build(size_t num_cuboids, NeighbourFn&& neighbours, unsigned num_threads)
+{
+    // Gather the neighbours of every cuboid once, then pack them
+    std::vector<std::vector<std::pair<uint32_t, float>>> rows(num_cuboids);
+    parallelFor(num_cuboids, [&](size_t c) {
+        auto& row = rows[c];
+        neighbours(static_cast<uint32_t>(c), row);
+        std::stable_sort(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        row.erase(std::unique(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), row.end());
+    }, num_threads);
+    offsets.resize(num_cuboids + 1);
+    offsets[0] = 0;
+    for (size_t c = 0; c < num_cuboids; c++) offsets[c + 1] = offsets[c] + static_cast<uint32_t>(rows[c].size());
+    neighbour_ids.resize(offsets.back());
+    areas.resize(offsets.back());
+    parallelFor(num_cuboids, [&](size_t c) {
+        for (size_t i = 0; i < rows[c].size(); i++) {
+            neighbour_ids[offsets[c] + i] = rows[c][i].first;
+            areas[offsets[c] + i] = rows[c][i].second;
+        }
+    }, num_threads);
+}
+#endif
@@ -0,0 +1,86 @@
+#include "EdgeTable.hpp"
+#include "Parallel.hpp"
+#include <algorithm>
+#include <tuple>
+
+static uint64_t edgeKey(uint32_t v1, uint32_t v2)
+{
+    return (static_cast<uint64_t>(std::min(v1, v2)) << 32) | std::max(v1, v2);
+}
+
+EdgeTable::EdgeTable(const Mesh& mesh, unsigned num_threads)
+{
+    const auto& mesh_cuboids = mesh.getCuboids();
+    // Every cuboid edge once, keyed on its vertices
+    struct CuboidEdge { uint64_t key; uint32_t cuboid; };
+    std::vector<CuboidEdge> all(mesh_cuboids.size() * Edge2Lv.size());
+    parallelFor(mesh_cuboids.size(), [&](size_t c) {
+        const auto& vertices = mesh_cuboids[c].vertices;
+        for (size_t i = 0; i < Edge2Lv.size(); i++) {
+            all[c * Edge2Lv.size() + i] = { edgeKey(vertices[Edge2Lv[i][0]], vertices[Edge2Lv[i][1]]), static_cast<uint32_t>(c) };
+        }
+    }, num_threads);
+    parallelSort(all.begin(), all.end(), [](const CuboidEdge& a, const CuboidEdge& b) {
+        return a.key < b.key || (a.key == b.key && a.cuboid < b.cuboid);
+    }, num_threads);
+
+    // Equal keys are adjacent now, one edge per run
+    edge_cuboids.resize(all.size());
+    offsets.reserve(all.size() / 3 + 1);
+    for (size_t i = 0; i < all.size(); i++) {
+        edge_cuboids[i] = all[i].cuboid;
+        if (i != 0 && all[i].key == all[i - 1].key) continue;
+        offsets.push_back(static_cast<uint32_t>(i));
+        edges.push_back({ static_cast<uint32_t>(all[i].key >> 32), static_cast<uint32_t>(all[i].key), all[i].cuboid });
+    }
+    offsets.push_back(static_cast<uint32_t>(all.size()));
+    findTJunctions(mesh.getVertices());
+}
+
+void EdgeTable::findTJunctions(const VertexStore& vertices)
+{
+    t_junction.assign(edges.size(), 0);
+    // Group the edges by the line they lie on, ordered along it
+    struct LineEdge { Axis axis; float a, b; float start, end; uint32_t edge; };
+    std::vector<LineEdge> lines(edges.size());
+    for (uint32_t e = 0; e < edges.size(); e++) {
+        const Vertex p = vertices[edges[e].v1];
+        const Vertex q = vertices[edges[e].v2];
+        const Axis axis = p.x != q.x ? Axis::x : (p.y != q.y ? Axis::y : Axis::z);
+        const Axis a = axis == Axis::x ? Axis::y : Axis::x;
+        const Axis b = axis == Axis::z ? Axis::y : Axis::z;
+        const float start = std::min(axisCoord(p, axis), axisCoord(q, axis));
+        const float end = std::max(axisCoord(p, axis), axisCoord(q, axis));
+        lines[e] = { axis, axisCoord(p, a), axisCoord(p, b), start, end, e };
+    }
+    const auto line_of = [](const LineEdge& l) { return std::tie(l.axis, l.a, l.b); };
+    std::sort(lines.begin(), lines.end(), [&](const LineEdge& l, const LineEdge& r) {
+        return std::tie(l.axis, l.a, l.b, l.start) < std::tie(r.axis, r.a, r.b, r.start);
+    });
+    std::vector<float> ends;
+    for (size_t begin = 0; begin < lines.size();) {
+        size_t end = begin;
+        ends.clear();
+        while (end < lines.size() && line_of(lines[end]) == line_of(lines[begin])) {
+            ends.push_back(lines[end].start);
+            ends.push_back(lines[end].end);
+            end++;
+        }
+        std::sort(ends.begin(), ends.end());
+        // An edge is a T-junction if an end of another edge on the line lies strictly inside it
+        for (size_t i = begin; i < end; i++) {
+            const auto next = std::upper_bound(ends.begin(), ends.end(), lines[i].start);
+            t_junction[lines[i].edge] = next != ends.end() && *next < lines[i].end;
+        }
+        begin = end;
+    }
+}
+
+uint32_t EdgeTable::find(uint32_t v1, uint32_t v2) const
+{
+    const auto it = std::lower_bound(edges.begin(), edges.end(), edgeKey(v1, v2), [](const Edge& edge, uint64_t key) {
+        return edgeKey(edge.v1, edge.v2) < key;
+    });
+    if (it == edges.end() || edgeKey(it->v1, it->v2) != edgeKey(v1, v2)) return static_cast<uint32_t>(-1);
+    return static_cast<uint32_t>(it - edges.begin());
+}
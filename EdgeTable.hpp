@@ -0,0 +1,45 @@
+#ifndef _EDGETABLE_HPP
+#define _EDGETABLE_HPP
+#include "Types.hpp"
+#include "Mesh.hpp"
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+/*
+* Local vertices of the 12 edges of a cuboid
+*/
+static constexpr std::array<std::array<uint8_t, 2>, 12> Edge2Lv = { {
+    {0,1}, {0,3}, {0,4}, {1,2}, {1,5}, {2,3},
+    {2,6}, {3,7}, {4,5}, {4,7}, {5,6}, {6,7}
+} };
+
+/*  EdgeTable class, the unique edges of all cuboids of a mesh
+*   Edges are numbered in order of their vertex ids, with v1 < v2, so the ids only depend on the mesh.
+*   For every edge the cuboids having it as one of their 12 edges are stored in compressed rows (CSR).
+*   An edge is a T-junction if a vertex lies in its interior, it is then split into shorter edges by the neighbouring cuboids.
+*/
+class EdgeTable
+{
+private:
+    std::vector<Edge> edges;
+    // The cuboids of edge e are edge_cuboids[offsets[e]] up to edge_cuboids[offsets[e + 1]]
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> edge_cuboids;
+    std::vector<uint8_t> t_junction;
+    void findTJunctions(const VertexStore& vertices);
+public:
+    EdgeTable() = default;
+    // Build the table with a parallel sort of the edges of all cuboids
+    EdgeTable(const Mesh& mesh, unsigned num_threads = 0);
+    size_t size() const { return edges.size(); }
+    // All edges, elem is the first cuboid of the edge
+    const std::vector<Edge>& getEdges() const { return edges; }
+    const Edge& operator[](uint32_t e) const { return edges[e]; }
+    // The cuboids having edge e as one of their edges
+    std::span<const uint32_t> cuboids(uint32_t e) const { return { edge_cuboids.data() + offsets[e], edge_cuboids.data() + offsets[e + 1] }; }
+    bool isTJunction(uint32_t e) const { return t_junction[e] != 0; }
+    // Id of the edge between two vertices, -1 if there is none
+    uint32_t find(uint32_t v1, uint32_t v2) const;
+};
+#endif
@@ -0,0 +1,57 @@
+#include "IncidenceOperator.hpp"
+#include "Parallel.hpp"
+#include <cassert>
+
+IncidenceOperator::IncidenceOperator(const EdgeTable& edges, const VertexStore& vertices) : num_vertices(vertices.size())
+{
+    assert(edges.size() < head_bit);
+    columns.resize(2 * edges.size());
+    vertex_offsets.assign(num_vertices + 1, 0);
+    for (uint32_t e = 0; e < edges.size(); e++) {
+        // Edges are axis aligned, so the head has all coordinates at least those of the tail
+        const bool v1_head = vertices[edges[e].v1] - vertices[edges[e].v2] >= Vertex{ 0.0f, 0.0f, 0.0f };
+        columns[2 * e] = v1_head ? edges[e].v2 : edges[e].v1;
+        columns[2 * e + 1] = v1_head ? edges[e].v1 : edges[e].v2;
+        vertex_offsets[edges[e].v1 + 1]++;
+        vertex_offsets[edges[e].v2 + 1]++;
+    }
+    // Counting sort of the entries by vertex gives the transpose
+    for (size_t v = 0; v < num_vertices; v++) vertex_offsets[v + 1] += vertex_offsets[v];
+    vertex_edges.resize(columns.size());
+    std::vector<uint32_t> fill(vertex_offsets.begin(), vertex_offsets.end() - 1);
+    for (uint32_t e = 0; e < edges.size(); e++) {
+        vertex_edges[fill[tail(e)]++] = e;
+        vertex_edges[fill[head(e)]++] = e | head_bit;
+    }
+}
+
+void IncidenceOperator::apply(std::span<const float> x, std::span<float> y, unsigned num_threads) const
+{
+    assert(x.size() == cols() && y.size() == rows());
+    parallelFor(rows(), [&](size_t e) { y[e] = x[columns[2 * e + 1]] - x[columns[2 * e]]; }, num_threads);
+}
+
+void IncidenceOperator::applyTranspose(std::span<const float> x, std::span<float> y, unsigned num_threads) const
+{
+    assert(x.size() == rows() && y.size() == cols());
+    parallelFor(cols(), [&](size_t v) {
+        float sum = 0.0f;
+        for (uint32_t i = vertex_offsets[v]; i < vertex_offsets[v + 1]; i++) {
+            const uint32_t entry = vertex_edges[i];
+            sum += (entry & head_bit) ? x[entry & ~head_bit] : -x[entry];
+        }
+        y[v] = sum;
+    }, num_threads);
+}
+
+Eigen::SparseMatrix<float, Eigen::RowMajor> IncidenceOperator::toSparse() const
+{
+    Eigen::SparseMatrix<float, Eigen::RowMajor> matrix(static_cast<Eigen::Index>(rows()), static_cast<Eigen::Index>(cols()));
+    matrix.reserve(Eigen::VectorXi::Constant(static_cast<Eigen::Index>(rows()), 2));
+    for (uint32_t e = 0; e < rows(); e++) {
+        matrix.insert(e, tail(e)) = -1.0f;
+        matrix.insert(e, head(e)) = 1.0f;
+    }
+    matrix.makeCompressed();
+    return matrix;
+}
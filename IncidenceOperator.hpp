@@ -0,0 +1,39 @@
+#ifndef _INCIDENCEOPERATOR_HPP
+#define _INCIDENCEOPERATOR_HPP
+#include "EdgeTable.hpp"
+#include "VertexStore.hpp"
+#include <Eigen/Sparse>
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+/*  IncidenceOperator class, the signed edge-vertex incidence matrix of a mesh
+*   Row e has -1 at the tail and +1 at the head of edge e, the head being the end further from the origin,
+*   so applying it to a vertex function gives its difference along every edge (a discrete gradient).
+*   Stored in compressed rows with exactly two entries per row, plus the transpose for applying it in parallel per vertex.
+*/
+class IncidenceOperator
+{
+private:
+    size_t num_vertices = 0;
+    // The columns of row e are tail, head at 2 * e and 2 * e + 1
+    std::vector<uint32_t> columns;
+    // Transpose: the edges of vertex v are vertex_edges[vertex_offsets[v]] up to vertex_edges[vertex_offsets[v + 1]],
+    // the highest bit is set if v is the head of the edge
+    std::vector<uint32_t> vertex_offsets;
+    std::vector<uint32_t> vertex_edges;
+    static constexpr uint32_t head_bit = uint32_t{ 1 } << 31;
+public:
+    IncidenceOperator() = default;
+    IncidenceOperator(const EdgeTable& edges, const VertexStore& vertices);
+    size_t rows() const { return columns.size() / 2; }
+    size_t cols() const { return num_vertices; }
+    uint32_t tail(uint32_t e) const { return columns[2 * e]; }
+    uint32_t head(uint32_t e) const { return columns[2 * e + 1]; }
+    // y = D x, x has an entry per vertex and y one per edge
+    void apply(std::span<const float> x, std::span<float> y, unsigned num_threads = 0) const;
+    // y = D^T x, x has an entry per edge and y one per vertex
+    void applyTranspose(std::span<const float> x, std::span<float> y, unsigned num_threads = 0) const;
+    Eigen::SparseMatrix<float, Eigen::RowMajor> toSparse() const;
+};
+#endif
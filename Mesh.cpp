@@ -1,4 +1,10 @@
 #include "Mesh.hpp"
+#include <robin_hood.h>
+#include "Parallel.hpp"
+#include "MeshSnapshot.hpp"
+#include <limits>
+#include <tuple>
+#include <sstream>
 
 #define TINYPLY_IMPLEMENTATION
 #include "tinyply.h"
@@ -18,6 +24,7 @@ Mesh::Mesh(/* args */) {
     vertices.push_back({ 0.0,1.0,1.0 });
     // Add initial 3D cuboid
     cuboids.push_back({ 0,1,2,3,4,5,6,7 });
+    boxes.push_back({ vertices[0], vertices[6] });
 
     // Add 6 border faces
     for (int i = 0; i < 6; i++) {
@@ -29,10 +36,20 @@ Mesh::Mesh(/* args */) {
     }
 }
 
-Mesh::Mesh(int Nx, int Ny, int Nz)
+Mesh::Mesh(Lattice mesh_lattice) : Mesh()
 {
+    if (mesh_lattice.levels > Lattice::max_levels) throw std::runtime_error("lattice has more than " + std::to_string(Lattice::max_levels) + " levels");
+    lattice = mesh_lattice;
+    sft.lattice = lattice;
+}
+
+Mesh::Mesh(int Nx, int Ny, int Nz, Lattice mesh_lattice) : lattice(mesh_lattice)
+{
+    if (lattice.levels > Lattice::max_levels) throw std::runtime_error("lattice has more than " + std::to_string(Lattice::max_levels) + " levels");
+    sft.lattice = lattice;
     vertices.reserve((Nx + 1) * (Ny + 1) * (Nz + 1));
     cuboids.reserve(Nx * Ny * Nz);
+    boxes.reserve(Nx * Ny * Nz);
     V2lV.reserve((Nx + 1) * (Ny + 1) * (Nz + 1));
     F2f.reserve(Nx * Ny * Nz * 6);
     const float Lx = 1 / static_cast<float>(Nx);
@@ -45,7 +62,7 @@ Mesh::Mesh(int Nx, int Ny, int Nz)
         {
             for (size_t i = 0; i <= Nx; i++)
             {
-                vertices.emplace_back(Vertex{i*Lx, j*Ly, k*Lz});
+                vertices.emplace_back(lattice.snap(Vertex{i*Lx, j*Ly, k*Lz}));
             }
         }
     }
@@ -58,6 +75,7 @@ Mesh::Mesh(int Nx, int Ny, int Nz)
             for (size_t i = 0; i < Nx; i++)
             {
                 cuboids.emplace_back(Cuboid{toVertIndex(i,j,k),toVertIndex(i+1,j,k),toVertIndex(i+1,j+1,k),toVertIndex(i,j+1,k),toVertIndex(i,j,k+1),toVertIndex(i + 1,j,k+1),toVertIndex(i + 1,j + 1,k+1),toVertIndex(i,j + 1,k+1) });
+                boxes.push_back({ vertices[toVertIndex(i, j, k)], vertices[toVertIndex(i + 1, j + 1, k + 1)] });
             }
         }
     }
@@ -108,15 +126,20 @@ Mesh::Mesh(int Nx, int Ny, int Nz)
             }
         }
     }
+    RebuildLocator();
 }
 
-const std::vector<Vertex>& Mesh::getVertices() const {
+const VertexStore& Mesh::getVertices() const {
     return vertices;
 }
 const std::vector<Cuboid>& Mesh::getCuboids() const {
     return cuboids;
 }
 
+const std::vector<Box>& Mesh::getBoxes() const {
+    return boxes;
+}
+
 const std::vector<halfFace>& Mesh::getF2f() const {
     return F2f;
 }
@@ -130,31 +153,292 @@ const SubFaceTree& Mesh::getSft() const
     return sft;
 }
 
-void Mesh::Save(const std::string& filename)
+const Lattice& Mesh::getLattice() const
+{
+    return lattice;
+}
+
+const PointLocator& Mesh::getLocator() const
+{
+    return locator;
+}
+
+const VertexStar& Mesh::getVertexStar() const
+{
+    if (star_valid) return star;
+    star.build(vertices.size(), [&](uint32_t v, std::array<uint32_t, 8>& star_of) {
+        // The cuboids touching v are exactly the cuboids just next to it
+        auto around = cuboidsAroundPoint(vertices[v]);
+        std::sort(around.begin(), around.end());
+        const auto end = std::unique(around.begin(), std::find(around.begin(), around.end(), static_cast<uint32_t>(-1)));
+        std::copy(around.begin(), end, star_of.begin());
+        return static_cast<size_t>(end - around.begin());
+    });
+    star_valid = true;
+    return star;
+}
+
+void Mesh::prepareForConcurrentReads()
+{
+    sft.threadLeaves();
+    getVertexStar();
+    getDualGraph();
+}
+
+const DualGraph& Mesh::getDualGraph() const
+{
+    if (dual_graph_valid) return dual_graph;
+    dual_graph.build(cuboids.size(), [&](uint32_t c, std::vector<std::pair<uint32_t, float>>& out) {
+        const Box& box = boxes[c];
+        for (uint8_t face = 0; face < 6; face++) {
+            const auto twin = Twin(halfFace(c, face));
+            if (twin.isBorder()) continue;
+            // Area of the overlap of the two boxes in the plane of the face
+            const auto addNeighbour = [&](uint32_t neighbour) {
+                const Box& other = boxes[neighbour];
+                float area = 1.0f;
+                for (const Axis axis : { Axis::x, Axis::y, Axis::z }) {
+                    if (axis == Hf2Ax[face]) continue;
+                    area *= std::min(axisCoord(box.max, axis), axisCoord(other.max, axis)) - std::max(axisCoord(box.min, axis), axisCoord(other.min, axis));
+                }
+                if (area > 0.0f) out.emplace_back(neighbour, area);
+            };
+            if (twin.isSubdivided()) {
+                for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) addNeighbour((*it).getCuboid());
+            }
+            else {
+                addNeighbour(twin.getCuboid());
+            }
+        }
+    });
+    dual_graph_valid = true;
+    return dual_graph;
+}
+
+void Mesh::Save(const std::string& filename, bool binary, bool unique_faces)
 {
     std::filebuf fb_binary;
-    fb_binary.open(filename + ".ply", std::ios::out);
+    fb_binary.open(filename + ".ply", std::ios::out | std::ios::binary);
     std::ostream outstream_binary(&fb_binary);
     if (outstream_binary.fail()) throw std::runtime_error("failed to open " + filename);
     tinyply::PlyFile file;
+    // Readers that skip the cuboids can size the domain from the header
+    const Box bounds = vertices.boundingBox();
+    std::ostringstream comment;
+    comment.precision(std::numeric_limits<float>::max_digits10);
+    comment << "bounding box " << bounds.min.x << ' ' << bounds.min.y << ' ' << bounds.min.z << ' ' << bounds.max.x << ' ' << bounds.max.y << ' ' << bounds.max.z;
+    file.get_comments().push_back(comment.str());
+    auto vertex_coords = vertices.interleaved();
     file.add_properties_to_element("vertex", { "x", "y", "z" },
-        tinyply::Type::FLOAT32, vertices.size(), reinterpret_cast<uint8_t*>(vertices.data()), tinyply::Type::INVALID, 0);
+        tinyply::Type::FLOAT32, vertices.size(), reinterpret_cast<uint8_t*>(vertex_coords.data()), tinyply::Type::INVALID, 0);
     std::vector<uint32_t> face_vert_ids;
-    face_vert_ids.reserve(6 * cuboids.size());
-    for(const auto& cub : cuboids)
+    face_vert_ids.reserve(4 * 6 * cuboids.size());
+    for (uint32_t cub = 0; cub < cuboids.size(); cub++)
     {
-        for (size_t i = 0; i < 6; i++)
+        for (uint8_t i = 0; i < 6; i++)
         {
-            face_vert_ids.push_back(cub.vertices[Hf2Ve[i][0]]);
-            face_vert_ids.push_back(cub.vertices[Hf2Ve[i][1]]);
-            face_vert_ids.push_back(cub.vertices[Hf2Ve[i][2]]);
-            face_vert_ids.push_back(cub.vertices[Hf2Ve[i][3]]);
+            if (unique_faces) {
+                // A face shared by two cuboids is written by the lowest halfFace, a face split in subfaces by the undivided side
+                const halfFace hf(cub, i);
+                const auto twin = Twin(hf);
+                const bool write = twin.isBorder() || twin.isSubdivided() || (Twin(twin) == hf && hf.id < twin.id);
+                if (!write) continue;
+            }
+            face_vert_ids.push_back(cuboids[cub].vertices[Hf2Ve[i][0]]);
+            face_vert_ids.push_back(cuboids[cub].vertices[Hf2Ve[i][1]]);
+            face_vert_ids.push_back(cuboids[cub].vertices[Hf2Ve[i][2]]);
+            face_vert_ids.push_back(cuboids[cub].vertices[Hf2Ve[i][3]]);
         }
     }
     file.add_properties_to_element("face", { "vertex_indices" },
-        tinyply::Type::UINT32, cuboids.size() * 6, reinterpret_cast<uint8_t*>(face_vert_ids.data()), tinyply::Type::UINT8, 4);
-    // Write a text file
-    file.write(outstream_binary, false);
+        tinyply::Type::UINT32, face_vert_ids.size() / 4, reinterpret_cast<uint8_t*>(face_vert_ids.data()), tinyply::Type::UINT8, 4);
+    // The cuboids themselves, so the mesh can be loaded again
+    file.add_properties_to_element("cuboid", { "vertex_indices" },
+        tinyply::Type::UINT32, cuboids.size(), reinterpret_cast<uint8_t*>(cuboids.data()), tinyply::Type::UINT8, 8);
+    file.write(outstream_binary, binary);
+}
+
+/*
+* Convert the values read by tinyply to type T, independent of the type in the file
+*/
+template<typename T>
+static std::vector<T> plyValues(tinyply::PlyData& data)
+{
+    auto convert = [&]<typename S>(S) {
+        const S* values = reinterpret_cast<const S*>(data.buffer.get());
+        return std::vector<T>(values, values + data.buffer.size_bytes() / sizeof(S));
+    };
+    switch (data.t)
+    {
+    case tinyply::Type::INT8: return convert(int8_t{});
+    case tinyply::Type::UINT8: return convert(uint8_t{});
+    case tinyply::Type::INT16: return convert(int16_t{});
+    case tinyply::Type::UINT16: return convert(uint16_t{});
+    case tinyply::Type::INT32: return convert(int32_t{});
+    case tinyply::Type::UINT32: return convert(uint32_t{});
+    case tinyply::Type::FLOAT32: return convert(float{});
+    case tinyply::Type::FLOAT64: return convert(double{});
+    default: throw std::runtime_error("unsupported ply property type");
+    }
+}
+
+void Mesh::Load(const std::string& filename)
+{
+    const std::string path = filename.ends_with(".ply") ? filename : filename + ".ply";
+    std::ifstream in(path, std::ios::in | std::ios::binary);
+    if (in.fail()) throw std::runtime_error("failed to open " + path);
+    tinyply::PlyFile file;
+    if (!file.parse_header(in)) throw std::runtime_error(path + " is not a ply file");
+    // Prefer the cuboids, otherwise every six faces describe one cuboid as written by Save
+    std::string cell_element = "face";
+    std::string cell_property;
+    size_t cell_size = 6 * 4;
+    for (const auto& element : file.get_elements()) {
+        if (element.name == "cuboid") {
+            cell_element = "cuboid";
+            cell_size = 8;
+        }
+    }
+    for (const auto& element : file.get_elements()) {
+        if (element.name != cell_element) continue;
+        for (const auto& property : element.properties) {
+            if (property.isList) cell_property = property.name;
+        }
+    }
+    if (cell_property.empty()) throw std::runtime_error(path + " has no cuboid or face element");
+    std::shared_ptr<tinyply::PlyData> vertex_data, cell_data;
+    try {
+        vertex_data = file.request_properties_from_element("vertex", { "x", "y", "z" });
+        cell_data = file.request_properties_from_element(cell_element, { cell_property }, cell_element == "cuboid" ? 8 : 4);
+        file.read(in);
+    }
+    catch (const std::exception& e) {
+        throw std::runtime_error("failed to read " + path + ": " + e.what());
+    }
+    const auto coords = plyValues<float>(*vertex_data);
+    const auto indices = plyValues<uint32_t>(*cell_data);
+    if (indices.empty() || indices.size() % cell_size != 0) throw std::runtime_error(path + " does not describe complete cuboids");
+    std::vector<Box> targets(indices.size() / cell_size);
+    for (size_t c = 0; c < targets.size(); c++) {
+        constexpr float inf = std::numeric_limits<float>::infinity();
+        Box box{ { inf, inf, inf }, { -inf, -inf, -inf } };
+        for (size_t i = c * cell_size; i < (c + 1) * cell_size; i++) {
+            if (3 * static_cast<size_t>(indices[i]) + 2 >= coords.size()) throw std::runtime_error(path + " has a vertex index out of range");
+            const Vertex v{ coords[3 * indices[i]], coords[3 * indices[i] + 1], coords[3 * indices[i] + 2] };
+            box.min = { std::min(box.min.x, v.x), std::min(box.min.y, v.y), std::min(box.min.z, v.z) };
+            box.max = { std::max(box.max.x, v.x), std::max(box.max.y, v.y), std::max(box.max.z, v.z) };
+        }
+        targets[c] = box;
+    }
+    rebuildFromBoxes(targets);
+}
+
+void Mesh::rebuildFromBoxes(std::span<const Box> targets)
+{
+    // Only meshes of the unit cube can be constructed
+    double volume = 0.0;
+    for (const auto& box : targets) {
+        if (!(box.min >= Vertex{ 0.0f, 0.0f, 0.0f }) || !(Vertex{ 1.0f, 1.0f, 1.0f } >= box.max)) throw std::runtime_error("cuboid outside of the unit cube");
+        const auto size = box.max - box.min;
+        volume += static_cast<double>(size.x) * static_cast<double>(size.y) * static_cast<double>(size.z);
+    }
+    if (std::abs(volume - 1.0) > 1e-4) throw std::runtime_error("cuboids do not fill the unit cube");
+    const bool hash_vertices = use_vertex_hash;
+    const bool history_enabled = track_history;
+    *this = Mesh(lattice);
+    EnableVertexHash(hash_vertices);
+    EnableHistory(history_enabled);
+    reserveSplits(targets.size() - 1);
+    // Replay the splits top down, every cuboid is cut along a plane that no target crosses
+    std::vector<uint32_t> ids(targets.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    struct Region { uint32_t cuboid; size_t begin, end; };
+    std::vector<Region> stack = { { 0, 0, ids.size() } };
+    while (!stack.empty()) {
+        const Region region = stack.back();
+        stack.pop_back();
+        if (region.end - region.begin == 1) continue;
+        const std::span<uint32_t> region_ids(ids.data() + region.begin, region.end - region.begin);
+        Axis axis = Axis::x;
+        float coordinate = 0.0f;
+        const size_t num_lower = PointLocator::findCut(region_ids, targets, axis, coordinate);
+        if (num_lower == 0) throw std::runtime_error("mesh can not be constructed by splitting cuboids");
+        const uint32_t top = SplitAlongAxis(region.cuboid, coordinate, axis);
+        if (top == static_cast<uint32_t>(-1)) throw std::runtime_error("failed to split at a cuboid boundary");
+        stack.push_back({ top, region.begin + num_lower, region.end });
+        stack.push_back({ region.cuboid, region.begin, region.begin + num_lower });
+    }
+    sft.threadLeaves();
+}
+
+void Mesh::SaveSnapshot(const std::string& filename) const
+{
+    std::ofstream out(filename, std::ios::out | std::ios::binary);
+    if (out.fail()) throw std::runtime_error("failed to open " + filename);
+    SnapshotHeader header{};
+    std::copy(std::begin(snapshot_magic), std::end(snapshot_magic), header.magic);
+    header.version = snapshot_version;
+    header.byte_order = snapshot_byte_order;
+    header.lattice_levels = lattice.levels;
+    std::tie(header.free_list_base, header.free_list_head) = sft.getFreeList();
+    header.num_vertices = vertices.size();
+    header.num_cuboids = cuboids.size();
+    header.num_nodes = sft.nodes.size();
+    const std::pair<const void*, uint64_t> sections[] = {
+        { vertices.coords(Axis::x), vertices.size() * sizeof(float) },
+        { vertices.coords(Axis::y), vertices.size() * sizeof(float) },
+        { vertices.coords(Axis::z), vertices.size() * sizeof(float) },
+        { cuboids.data(), cuboids.size() * sizeof(Cuboid) },
+        { boxes.data(), boxes.size() * sizeof(Box) },
+        { F2f.data(), F2f.size() * sizeof(halfFace) },
+        { V2lV.data(), V2lV.size() * sizeof(localVertex) },
+        { sft.nodes.data(), sft.nodes.size() * sizeof(Node) }
+    };
+    auto align = [](uint64_t offset) { return (offset + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment; };
+    uint64_t offset = align(sizeof(SnapshotHeader));
+    for (size_t i = 0; i < static_cast<size_t>(SnapshotSection::count); i++) {
+        header.offsets[i] = offset;
+        header.sizes[i] = sections[i].second;
+        offset = align(offset + sections[i].second);
+    }
+    const char padding[snapshot_alignment] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    uint64_t written = sizeof(header);
+    for (size_t i = 0; i < static_cast<size_t>(SnapshotSection::count); i++) {
+        out.write(padding, static_cast<std::streamsize>(header.offsets[i] - written));
+        out.write(static_cast<const char*>(sections[i].first), static_cast<std::streamsize>(sections[i].second));
+        written = header.offsets[i] + sections[i].second;
+    }
+    if (out.fail()) throw std::runtime_error("failed to write " + filename);
+}
+
+void Mesh::LoadSnapshot(const std::string& filename)
+{
+    const MappedFile file(filename);
+    const auto& header = checkSnapshot(file.data(), file.size());
+    const auto x = snapshotSection<float>(file.data(), header, SnapshotSection::x);
+    const auto y = snapshotSection<float>(file.data(), header, SnapshotSection::y);
+    const auto z = snapshotSection<float>(file.data(), header, SnapshotSection::z);
+    const auto snapshot_cuboids = snapshotSection<Cuboid>(file.data(), header, SnapshotSection::cuboids);
+    const auto snapshot_boxes = snapshotSection<Box>(file.data(), header, SnapshotSection::boxes);
+    const auto snapshot_F2f = snapshotSection<halfFace>(file.data(), header, SnapshotSection::F2f);
+    const auto snapshot_V2lV = snapshotSection<localVertex>(file.data(), header, SnapshotSection::V2lV);
+    const auto snapshot_nodes = snapshotSection<Node>(file.data(), header, SnapshotSection::nodes);
+    vertices.assign(x.data(), y.data(), z.data(), x.size());
+    cuboids.assign(snapshot_cuboids.begin(), snapshot_cuboids.end());
+    boxes.assign(snapshot_boxes.begin(), snapshot_boxes.end());
+    F2f.assign(snapshot_F2f.begin(), snapshot_F2f.end());
+    V2lV.assign(snapshot_V2lV.begin(), snapshot_V2lV.end());
+    sft.nodes.assign(snapshot_nodes.begin(), snapshot_nodes.end());
+    sft.setFreeList(header.free_list_base, header.free_list_head);
+    sft.threadLeaves();
+    lattice.levels = static_cast<uint8_t>(header.lattice_levels);
+    sft.lattice = lattice;
+    RebuildLocator();
+    if (use_vertex_hash) vertex_hash.build(vertices, lattice);
+    if (track_history) history.reset(cuboids.size());
+    star_valid = false;
+    dual_graph_valid = false;
 }
 
 void Mesh::splitHalfFace(const halfFace toSplit, const halfFace lower, const halfFace higher, const Axis split_axis, const Vertex& split_point)
@@ -221,7 +505,7 @@ constexpr int localIndexinFace(uint8_t face_ind, uint8_t local_vertex_idx) {
     return std::distance(std::cbegin(Hf2Ve[face_ind]), res);
 }
 
-std::pair<bool, uint32_t> Mesh::mergeVertexIfExists(const Vertex& v, HalfFacePair toCheck, uint8_t local_id, Axis split_axis)
+std::pair<bool, uint32_t> Mesh::mergeVertexIfExists(const Vertex& v, HalfFacePair toCheck, uint8_t local_id, Axis split_axis) const
 {
     // HalfFace in which the vertex to be found lays
     halfFace face{border_id};
@@ -235,7 +519,7 @@ std::pair<bool, uint32_t> Mesh::mergeVertexIfExists(const Vertex& v, HalfFacePai
                 const auto local_vertex_in_opposite = Hf2Ve[opposite_face(hf.getLocalId())][localIndexinFace(hf.getLocalId(), local_id)];
                 vref = cuboids[face.getCuboid()].vertices[local_vertex_in_opposite];
                 // Check if the vertex actually corresponds, this is sometimes not the case if the other side is also subdivided
-                if (vertices[vref] == v) {
+                if (lattice.sameVertex(vertices[vref], v)) {
                     return true;
                 }
             }
@@ -279,17 +563,22 @@ bool Mesh::Adjacent(uint32_t elem1, uint32_t elem2) const
 }
 
 void Mesh::addHalfFaces(const uint32_t cuboid_id, const Axis split_axis) {
-    // For now just push back the twins of the original element
-    (split_axis == Axis::z) ? F2f.push_back(halfFace(cuboid_id, 1)) : F2f.push_back(Twin(halfFace(cuboid_id, 0)));
-    F2f.push_back(Twin(halfFace(cuboid_id, 1)));
-    F2f.push_back(Twin(halfFace(cuboid_id, 2)));
-    F2f.push_back(Twin(halfFace(cuboid_id, 3)));
-    (split_axis == Axis::y) ? F2f.push_back((halfFace(cuboid_id, 2))) : F2f.push_back(Twin(halfFace(cuboid_id, 4)));
-    (split_axis == Axis::x) ? F2f.push_back(halfFace(cuboid_id, 3)) : F2f.push_back(Twin(halfFace(cuboid_id, 5)));
+    F2f.resize(F2f.size() + 6, halfFace(border_id));
+    writeHalfFaces(cuboid_id, static_cast<uint32_t>(F2f.size() / 6 - 1), split_axis);
 }
 
+void Mesh::writeHalfFaces(const uint32_t cuboid_id, const uint32_t new_cuboid_id, const Axis split_axis) {
+    // For now just copy the twins of the original element
+    halfFace* new_faces = &F2f[static_cast<size_t>(new_cuboid_id) * 6];
+    new_faces[0] = (split_axis == Axis::z) ? halfFace(cuboid_id, 1) : Twin(halfFace(cuboid_id, 0));
+    new_faces[1] = Twin(halfFace(cuboid_id, 1));
+    new_faces[2] = Twin(halfFace(cuboid_id, 2));
+    new_faces[3] = Twin(halfFace(cuboid_id, 3));
+    new_faces[4] = (split_axis == Axis::y) ? halfFace(cuboid_id, 2) : Twin(halfFace(cuboid_id, 4));
+    new_faces[5] = (split_axis == Axis::x) ? halfFace(cuboid_id, 3) : Twin(halfFace(cuboid_id, 5));
+}
 
-uint32_t Mesh::SplitAlongAxis(uint32_t cuboid_id, float split_point, Axis axis) {
+bool Mesh::prepareSplit(uint32_t cuboid_id, float split_point, Axis axis, PreparedSplit& split, bool find_vertices) const {
     uint8_t face_to_split = -1;
     switch (axis) {
         case Axis::x : 
@@ -303,24 +592,13 @@ uint32_t Mesh::SplitAlongAxis(uint32_t cuboid_id, float split_point, Axis axis)
             break;
         default:
             std::cout << "Invalid axis given. Returning -1 ..." << std::endl;
-            return -1;
+            return false;
     }
 
-    // border checks, return -1 if splitpoint is not in cuboid
-    if (axis == Axis::x) {
-        if ((split_point <= vertices[cuboids[cuboid_id].v1].x) || split_point >= vertices[cuboids[cuboid_id].v2].x) {
-            return -1;
-        }
-    }
-    else if (axis == Axis::y) {
-        if ((split_point <= vertices[cuboids[cuboid_id].v2].y) || split_point >= vertices[cuboids[cuboid_id].v3].y) {
-            return -1;
-        }
-    }
-    else {
-        if ((split_point <= vertices[cuboids[cuboid_id].v1].z) || split_point >= vertices[cuboids[cuboid_id].v5].z) {
-            return -1;
-        }
+    split_point = lattice.snap(split_point);
+    // border checks, return false if splitpoint is not in cuboid
+    if (split_point <= axisCoord(boxes[cuboid_id].min, axis) || split_point >= axisCoord(boxes[cuboid_id].max, axis)) {
+        return false;
     }
 
     // All the old vertices
@@ -335,7 +613,7 @@ uint32_t Mesh::SplitAlongAxis(uint32_t cuboid_id, float split_point, Axis axis)
     });
 
     // All the new vertices
-    std::array<Vertex, 4> v_new;
+    std::array<Vertex, 4>& v_new = split.v_new;
     std::generate(v_new.begin(), v_new.end(), [&, idx = 0]() mutable {
         switch (axis) {
             case Axis::x :
@@ -347,33 +625,52 @@ uint32_t Mesh::SplitAlongAxis(uint32_t cuboid_id, float split_point, Axis axis)
         }
     });
 
-    const auto middle = (v_new[0] + v_new[2]) / 2;
-    const uint32_t new_cuboid_id = cuboids.size();
-    std::array<uint32_t, 4> vertex_inds;
-    
+    split.cuboid_id = cuboid_id;
+    split.axis = axis;
+    split.face_to_split = face_to_split;
+    split.middle = (v_new[0] + v_new[2]) / 2;
+
+    if (!find_vertices) return true;
+    for (size_t i = 0; i < split.vertex_inds.size(); i++)
+    {
+        split.vertex_inds[i] = findSplitVertex(split, i);
+    }
+    return true;
+}
+
+uint32_t Mesh::findSplitVertex(const PreparedSplit& split, size_t i) const {
+    if (use_vertex_hash) {
+        const uint32_t vertex = vertex_hash.find(split.v_new[i], vertices);
+        return vertex == static_cast<uint32_t>(-1) ? border_id : vertex;
+    }
+    const uint32_t cuboid_id = split.cuboid_id;
+    HalfFacePair hfp({ uint32_t(-1) }, { uint8_t(-1) });
+    switch (split.axis) {
+        case Axis::x:
+            hfp = { {cuboid_id, Hfs2Check[0][i][0]}, {cuboid_id, Hfs2Check[0][i][1]} };
+            break;
+        case Axis::y:
+            hfp = { {cuboid_id, Hfs2Check[1][i][0]}, {cuboid_id, Hfs2Check[1][i][1]} };
+            break;
+        default:
+            hfp = { {cuboid_id, Hfs2Check[2][i][0]}, {cuboid_id, Hfs2Check[2][i][1]} };
+            break;
+    }
+
+    const auto [found, vertex] = mergeVertexIfExists(split.v_new[i], hfp, Hf2Ve[split.face_to_split][i], split.axis);
+    return found ? vertex : border_id;
+}
+
+void Mesh::commitSplit(const PreparedSplit& split, uint32_t new_cuboid_id, uint32_t first_new_vertex) {
+    const uint32_t cuboid_id = split.cuboid_id;
+    const uint8_t face_to_split = split.face_to_split;
+    std::array<uint32_t, 4> vertex_inds = split.vertex_inds;
     for (size_t i = 0; i < vertex_inds.size(); i++)
     {
-        HalfFacePair hfp({ uint32_t(-1) }, { uint8_t(-1) });
-        switch (axis) {
-            case Axis::x:
-                hfp = { {cuboid_id, Hfs2Check[0][i][0]}, {cuboid_id, Hfs2Check[0][i][1]} };
-                break;
-            case Axis::y:
-                hfp = { {cuboid_id,  Hfs2Check[1][i][0]}, {cuboid_id, Hfs2Check[1][i][0]} };
-                break;
-            default:
-                hfp = { {cuboid_id, Hfs2Check[2][i][0]}, {cuboid_id, Hfs2Check[2][i][1]} };
-                break;
-        }
-        
-        const auto [found, vertex] = mergeVertexIfExists(v_new[i], hfp, Hf2Ve[face_to_split][i], axis);
-        if (found) {
-            vertex_inds[i] = vertex;
-        }
-        else {
-            vertex_inds[i] = vertices.size();
-            V2lV.push_back({ new_cuboid_id, Hf2Ve[opposite_face(face_to_split)][i] });
-            vertices.push_back(v_new[i]);
+        if (vertex_inds[i] == border_id) {
+            vertex_inds[i] = first_new_vertex++;
+            V2lV[vertex_inds[i]] = localVertex(new_cuboid_id, Hf2Ve[opposite_face(face_to_split)][i]);
+            vertices.set(vertex_inds[i], split.v_new[i]);
         }
     }
 
@@ -382,29 +679,65 @@ uint32_t Mesh::SplitAlongAxis(uint32_t cuboid_id, float split_point, Axis axis)
         V2lV[cuboids[cuboid_id].vertices[lv]] = localVertex(new_cuboid_id, lv);
     }
 
+    // The old element keeps the lower part of the box
+    const float split_coord = axisCoord(split.middle, split.axis);
+    boxes[new_cuboid_id] = boxes[cuboid_id];
+    axisCoord(boxes[cuboid_id].max, split.axis) = split_coord;
+    axisCoord(boxes[new_cuboid_id].min, split.axis) = split_coord;
+
     // Update all the vertices for the new and old element
-    cuboids.push_back(cuboids[cuboid_id]);
+    cuboids[new_cuboid_id] = cuboids[cuboid_id];
     for (size_t i = 0; i < vertex_inds.size(); i++)
     {
         cuboids[cuboid_id].vertices[Hf2Ve[face_to_split][i]] = vertex_inds[i];
         cuboids[new_cuboid_id].vertices[Hf2Ve[opposite_face(face_to_split)][i]] = vertex_inds[i];
     }
 
-    addHalfFaces(cuboid_id, axis);
+    writeHalfFaces(cuboid_id, new_cuboid_id, split.axis);
+}
 
+void Mesh::linkSplit(const PreparedSplit& split, uint32_t new_cuboid_id) {
+    const uint32_t cuboid_id = split.cuboid_id;
+    const uint8_t face_to_split = split.face_to_split;
     // Update the twin faces (mark them as subdivided).
-    for (size_t hf = 0; hf < 6; hf++)
+    for (uint8_t hf = 0; hf < 6; hf++)
     {
         if (hf == face_to_split || hf == opposite_face(face_to_split)) continue;
-        splitHalfFace(halfFace(cuboid_id, hf), halfFace(cuboid_id, hf), halfFace(new_cuboid_id, hf), axis, middle);
+        splitHalfFace(halfFace(cuboid_id, hf), halfFace(cuboid_id, hf), halfFace(new_cuboid_id, hf), split.axis, split.middle);
     }
 
     // Update the top halfFace
-    updateHalfFace(halfFace(cuboid_id, face_to_split), halfFace(new_cuboid_id, face_to_split), middle);
+    updateHalfFace(halfFace(cuboid_id, face_to_split), halfFace(new_cuboid_id, face_to_split), split.middle);
     
     // Point the top of the old cuboid to the new cuboid
     Twin(halfFace(cuboid_id, face_to_split)) = halfFace(new_cuboid_id, opposite_face(face_to_split));
 
+    locator.split(cuboid_id, split.axis, axisCoord(split.middle, split.axis), new_cuboid_id);
+    if (track_history) history.split(cuboid_id, split.axis, axisCoord(split.middle, split.axis), new_cuboid_id);
+
+    star_valid = false;
+    dual_graph_valid = false;
+    if (use_vertex_hash) {
+        for (size_t i = 0; i < split.vertex_inds.size(); i++) {
+            if (split.vertex_inds[i] == border_id) vertex_hash.insert(cuboids[new_cuboid_id].vertices[Hf2Ve[opposite_face(face_to_split)][i]], split.v_new[i]);
+        }
+    }
+}
+
+uint32_t Mesh::SplitAlongAxis(uint32_t cuboid_id, float split_point, Axis axis) {
+    PreparedSplit split;
+    if (!prepareSplit(cuboid_id, split_point, axis, split)) {
+        return no_cuboid;
+    }
+    const uint32_t new_cuboid_id = static_cast<uint32_t>(cuboids.size());
+    const uint32_t first_new_vertex = static_cast<uint32_t>(vertices.size());
+    cuboids.resize(new_cuboid_id + 1);
+    boxes.resize(new_cuboid_id + 1);
+    F2f.resize(F2f.size() + 6, halfFace(border_id));
+    vertices.resize(first_new_vertex + split.numNewVertices());
+    V2lV.resize(vertices.size(), localVertex(0, 0));
+    commitSplit(split, new_cuboid_id, first_new_vertex);
+    linkSplit(split, new_cuboid_id);
     return new_cuboid_id;
 }
 
@@ -419,4 +752,826 @@ uint32_t Mesh::SplitAlongYZ(uint32_t cuboid_id, float x_split) {
 
 uint32_t Mesh::SplitAlongXZ(uint32_t cuboid_id, float y_split) {
     return SplitAlongAxis(cuboid_id, y_split, Axis::y);
-}
\ No newline at end of file
+}
+
+template<typename T>
+static void reserveAdditional(T& vec, size_t additional) {
+    const size_t required = vec.size() + additional;
+    if (required > vec.capacity()) {
+        vec.reserve(std::max(required, 2 * vec.capacity()));
+    }
+}
+
+void Mesh::reserveSplits(size_t num_splits)
+{
+    // A split adds one cuboid, six halfFaces, at most four vertices and typically at most four subface nodes
+    reserveAdditional(cuboids, num_splits);
+    reserveAdditional(boxes, num_splits);
+    reserveAdditional(F2f, 6 * num_splits);
+    reserveAdditional(vertices, 4 * num_splits);
+    reserveAdditional(V2lV, 4 * num_splits);
+    reserveAdditional(sft.nodes, 4 * num_splits);
+}
+
+std::vector<uint32_t> Mesh::SplitAlongAxisMulti(uint32_t cuboid_id, Axis axis, std::span<const float> planes)
+{
+    std::array<std::vector<float>, 3> lines;
+    for (uint8_t a = 0; a < 3; a++) lines[a] = { axisCoord(boxes[cuboid_id].min, static_cast<Axis>(a)) };
+    std::vector<float>& cuts = lines[static_cast<uint8_t>(axis)];
+    std::vector<float> sorted(planes.begin(), planes.end());
+    std::sort(sorted.begin(), sorted.end());
+    for (const float plane : sorted) {
+        const float line = lattice.snap(plane);
+        if (line > cuts.back() && line < axisCoord(boxes[cuboid_id].max, axis)) cuts.push_back(line);
+    }
+    for (uint8_t a = 0; a < 3; a++) lines[a].push_back(axisCoord(boxes[cuboid_id].max, static_cast<Axis>(a)));
+    return splitGrid(cuboid_id, lines);
+}
+
+std::vector<uint32_t> Mesh::Subdivide(uint32_t cuboid_id, uint32_t nx, uint32_t ny, uint32_t nz)
+{
+    assert(nx > 0 && ny > 0 && nz > 0);
+    const std::array<uint32_t, 3> n{ nx, ny, nz };
+    // The grid lines of the children along every axis, snapped to the lattice as SplitAlongAxis would
+    std::array<std::vector<float>, 3> lines;
+    for (uint8_t a = 0; a < 3; a++) {
+        const Axis axis = static_cast<Axis>(a);
+        const float low = axisCoord(boxes[cuboid_id].min, axis);
+        const float high = axisCoord(boxes[cuboid_id].max, axis);
+        lines[a].reserve(n[a] + 1);
+        lines[a].push_back(low);
+        for (uint32_t i = 1; i < n[a]; i++) {
+            const float line = lattice.snap(low + (high - low) * static_cast<float>(i) / static_cast<float>(n[a]));
+            // Every plane has to cut, otherwise the children would not be at their documented index
+            if (line <= lines[a].back() || line >= high) return {};
+            lines[a].push_back(line);
+        }
+        lines[a].push_back(high);
+    }
+    return splitGrid(cuboid_id, lines);
+}
+
+std::vector<uint32_t> Mesh::splitGrid(uint32_t cuboid_id, const std::array<std::vector<float>, 3>& lines)
+{
+    const std::array<uint32_t, 3> n{ static_cast<uint32_t>(lines[0].size() - 1), static_cast<uint32_t>(lines[1].size() - 1), static_cast<uint32_t>(lines[2].size() - 1) };
+    const uint32_t nx = n[0], ny = n[1], nz = n[2];
+    // Allocate all children and at most every grid point but the corners as new vertices at once, the unused vertices are dropped at the end
+    const size_t num_points = static_cast<size_t>(nx + 1) * (ny + 1) * (nz + 1);
+    uint32_t next_cuboid = static_cast<uint32_t>(cuboids.size());
+    uint32_t next_vertex = static_cast<uint32_t>(vertices.size());
+    reserveSplits(static_cast<size_t>(nx) * ny * nz - 1);
+    cuboids.resize(cuboids.size() + static_cast<size_t>(nx) * ny * nz - 1);
+    boxes.resize(cuboids.size());
+    F2f.resize(cuboids.size() * 6, halfFace(border_id));
+    vertices.resize(vertices.size() + num_points - 8);
+    V2lV.resize(vertices.size(), localVertex(0, 0));
+    // Vertex ids of the grid points created so far, only the points on the boundary of the cuboid can already exist in the mesh
+    std::vector<uint32_t> grid(num_points, border_id);
+    // Split the cuboid spanning the grid points low to high at a grid line like SplitAlongAxis, but take the vertices
+    // created by earlier splits from the grid instead of searching the subface trees for them
+    const auto splitAt = [&](uint32_t cuboid, Axis axis, uint32_t line, const std::array<uint32_t, 3>& low, const std::array<uint32_t, 3>& high) {
+        PreparedSplit split;
+        [[maybe_unused]] const bool cuts = prepareSplit(cuboid, lines[static_cast<uint8_t>(axis)][line], axis, split, false);
+        assert(cuts);
+        std::array<size_t, 4> points;
+        for (size_t i = 0; i < split.vertex_inds.size(); i++) {
+            std::array<uint32_t, 3> point;
+            bool on_boundary = false;
+            for (uint8_t a = 0; a < 3; a++) {
+                point[a] = a == static_cast<uint8_t>(axis) ? line : axisCoord(split.v_new[i], static_cast<Axis>(a)) == lines[a][low[a]] ? low[a] : high[a];
+                on_boundary |= point[a] == 0 || point[a] == n[a];
+            }
+            points[i] = (static_cast<size_t>(point[2]) * (ny + 1) + point[1]) * (nx + 1) + point[0];
+            split.vertex_inds[i] = grid[points[i]];
+            if (split.vertex_inds[i] == border_id && on_boundary) split.vertex_inds[i] = findSplitVertex(split, i);
+        }
+        const uint32_t new_cuboid = next_cuboid++;
+        commitSplit(split, new_cuboid, next_vertex);
+        linkSplit(split, new_cuboid);
+        next_vertex += split.numNewVertices();
+        for (size_t i = 0; i < points.size(); i++) {
+            grid[points[i]] = cuboids[new_cuboid].vertices[Hf2Ve[opposite_face(split.face_to_split)][i]];
+        }
+        return new_cuboid;
+    };
+    // Cut slabs along z first, then rows along y and finally cells along x, which are nx * ny * nz - 1 splits in total.
+    // The lower part keeps the id of a split cuboid, so every slab and row starts at its first child
+    std::vector<uint32_t> children(static_cast<size_t>(nx) * ny * nz);
+    const auto child = [&](uint32_t i, uint32_t j, uint32_t k) -> uint32_t& { return children[i + (j + static_cast<size_t>(k) * ny) * nx]; };
+    child(0, 0, 0) = cuboid_id;
+    for (uint32_t k = 1; k < nz; k++) child(0, 0, k) = splitAt(child(0, 0, k - 1), Axis::z, k, { 0, 0, k - 1 }, { nx, ny, nz });
+    for (uint32_t k = 0; k < nz; k++) {
+        for (uint32_t j = 1; j < ny; j++) child(0, j, k) = splitAt(child(0, j - 1, k), Axis::y, j, { 0, j - 1, k }, { nx, ny, k + 1 });
+        for (uint32_t j = 0; j < ny; j++) {
+            for (uint32_t i = 1; i < nx; i++) child(i, j, k) = splitAt(child(i - 1, j, k), Axis::x, i, { i - 1, j, k }, { nx, j + 1, k + 1 });
+        }
+    }
+    assert(next_cuboid == cuboids.size());
+    vertices.resize(next_vertex);
+    V2lV.resize(next_vertex, localVertex(0, 0));
+    return children;
+}
+
+std::vector<uint32_t> Mesh::Balance(float max_ratio, std::span<const uint32_t> start)
+{
+    assert(max_ratio >= 1.0f);
+    // A neighbour of cuboid that is more than max_ratio times as long along a side of their common face, -1 if there is none
+    const auto findCoarseNeighbour = [&](uint32_t cuboid, Axis& axis) {
+        const Vertex size = boxes[cuboid].max - boxes[cuboid].min;
+        const auto tooCoarse = [&](const halfFace neighbour, uint8_t face) {
+            const Vertex neighbour_size = boxes[neighbour.getCuboid()].max - boxes[neighbour.getCuboid()].min;
+            for (const Axis side : { Axis::x, Axis::y, Axis::z }) {
+                if (side == Hf2Ax[face] || axisCoord(neighbour_size, side) <= max_ratio * axisCoord(size, side) + eps) continue;
+                axis = side;
+                return true;
+            }
+            return false;
+        };
+        for (uint8_t face = 0; face < 6; face++) {
+            const auto twin = Twin(halfFace(cuboid, face));
+            if (twin.isBorder()) continue;
+            if (!twin.isSubdivided()) {
+                if (tooCoarse(twin, face)) return twin.getCuboid();
+                continue;
+            }
+            for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) {
+                if (tooCoarse(*it, face)) return (*it).getCuboid();
+            }
+        }
+        return static_cast<uint32_t>(-1);
+    };
+    // Worklist of cuboids whose neighbours may be too coarse, every split adds both halves
+    std::vector<uint32_t> worklist;
+    std::vector<uint8_t> queued(cuboids.size(), 0);
+    const auto enqueue = [&](uint32_t cuboid) {
+        if (cuboid >= queued.size()) queued.resize(cuboid + 1, 0);
+        if (queued[cuboid]) return;
+        queued[cuboid] = 1;
+        worklist.push_back(cuboid);
+    };
+    if (start.empty()) {
+        for (uint32_t cuboid = 0; cuboid < cuboids.size(); cuboid++) enqueue(cuboid);
+    }
+    else {
+        for (const auto cuboid : start) enqueue(cuboid);
+    }
+    std::vector<uint32_t> changed;
+    while (!worklist.empty()) {
+        const uint32_t cuboid = worklist.back();
+        worklist.pop_back();
+        queued[cuboid] = 0;
+        Axis axis;
+        for (uint32_t coarse = findCoarseNeighbour(cuboid, axis); coarse != static_cast<uint32_t>(-1); coarse = findCoarseNeighbour(cuboid, axis)) {
+            const uint32_t new_cuboid = SplitAlongAxis(coarse, axisCoord(boxes[coarse].center(), axis), axis);
+            // The split is impossible on the lattice, accept the ratio
+            if (new_cuboid == static_cast<uint32_t>(-1)) break;
+            changed.push_back(coarse);
+            changed.push_back(new_cuboid);
+            enqueue(coarse);
+            enqueue(new_cuboid);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    sft.threadLeaves();
+    return changed;
+}
+
+std::vector<uint32_t> Mesh::ColourSplits(std::span<const SplitRequest> requests) const
+{
+    // Colours already used around every cuboid and vertex, a request conflicts with every earlier request
+    // whose cuboid or face neighbours overlap its own cuboid and face neighbours, or that shares a vertex
+    robin_hood::unordered_map<uint32_t, std::vector<uint32_t>> cuboid_colours;
+    robin_hood::unordered_map<uint32_t, std::vector<uint32_t>> vertex_colours;
+    robin_hood::unordered_map<uint32_t, uint32_t> min_colour;
+    std::vector<uint32_t> colours(requests.size());
+    std::vector<uint32_t> footprint;
+    std::vector<uint32_t> used;
+    for (size_t r = 0; r < requests.size(); r++) {
+        const uint32_t cuboid_id = requests[r].cuboid;
+        assert(cuboid_id < cuboids.size());
+        footprint.assign(1, cuboid_id);
+        for (uint8_t i = 0; i < 6; i++) {
+            const auto twin = Twin(halfFace(cuboid_id, i));
+            if (twin.isBorder()) continue;
+            if (twin.isSubdivided()) {
+                for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) footprint.push_back((*it).getCuboid());
+            }
+            else {
+                footprint.push_back(twin.getCuboid());
+            }
+        }
+        used.clear();
+        for (const auto cuboid : footprint) {
+            const auto found = cuboid_colours.find(cuboid);
+            if (found != cuboid_colours.end()) used.insert(used.end(), found->second.begin(), found->second.end());
+        }
+        for (const auto vertex : cuboids[cuboid_id].vertices) {
+            const auto found = vertex_colours.find(vertex);
+            if (found != vertex_colours.end()) used.insert(used.end(), found->second.begin(), found->second.end());
+        }
+        std::sort(used.begin(), used.end());
+        // Smallest free colour, requests on the same cuboid must come after the previous one
+        uint32_t colour = min_colour[cuboid_id];
+        for (const auto c : used) {
+            if (c == colour) colour++;
+            else if (c > colour) break;
+        }
+        colours[r] = colour;
+        min_colour[cuboid_id] = colour + 1;
+        for (const auto cuboid : footprint) cuboid_colours[cuboid].push_back(colour);
+        for (const auto vertex : cuboids[cuboid_id].vertices) vertex_colours[vertex].push_back(colour);
+    }
+    return colours;
+}
+
+std::vector<uint32_t> Mesh::SplitParallel(std::span<const SplitRequest> requests, unsigned num_threads)
+{
+    const auto colours = ColourSplits(requests);
+    std::vector<uint32_t> order(requests.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return colours[a] < colours[b]; });
+    reserveSplits(requests.size());
+
+    std::vector<uint32_t> new_ids(requests.size(), no_cuboid);
+    std::vector<PreparedSplit> prepared;
+    std::vector<uint8_t> valid;
+    std::vector<uint32_t> cuboid_offsets;
+    std::vector<uint32_t> vertex_offsets;
+    for (size_t begin = 0; begin < order.size();) {
+        size_t end = begin;
+        while (end < order.size() && colours[order[end]] == colours[order[begin]]) end++;
+        const std::span<const uint32_t> colour_class(order.data() + begin, end - begin);
+        const size_t n = colour_class.size();
+        prepared.resize(n);
+        valid.resize(n);
+        // Checks and vertex lookups only read the mesh
+        parallelFor(n, [&](size_t i) {
+            const auto& request = requests[colour_class[i]];
+            valid[i] = prepareSplit(request.cuboid, request.coordinate, request.axis, prepared[i]);
+        }, num_threads, 16);
+        // Prefix sums give every split its own range of new ids, in the same order as sequential splitting
+        cuboid_offsets.resize(n);
+        vertex_offsets.resize(n);
+        uint32_t num_cuboids = static_cast<uint32_t>(cuboids.size());
+        uint32_t num_vertices = static_cast<uint32_t>(vertices.size());
+        for (size_t i = 0; i < n; i++) {
+            cuboid_offsets[i] = num_cuboids;
+            vertex_offsets[i] = num_vertices;
+            if (!valid[i]) continue;
+            new_ids[colour_class[i]] = num_cuboids++;
+            num_vertices += prepared[i].numNewVertices();
+        }
+        cuboids.resize(num_cuboids);
+        boxes.resize(num_cuboids);
+        F2f.resize(static_cast<size_t>(num_cuboids) * 6, halfFace(border_id));
+        vertices.resize(num_vertices);
+        V2lV.resize(num_vertices, localVertex(0, 0));
+        // Splits of one colour share no cuboids or vertices, so they write disjoint entries
+        parallelFor(n, [&](size_t i) {
+            if (valid[i]) commitSplit(prepared[i], cuboid_offsets[i], vertex_offsets[i]);
+        }, num_threads, 16);
+        // The subface trees are shared, so the twins are linked in order
+        for (size_t i = 0; i < n; i++) {
+            if (valid[i]) linkSplit(prepared[i], cuboid_offsets[i]);
+        }
+        begin = end;
+    }
+    sft.threadLeaves();
+    return new_ids;
+}
+
+uint32_t Mesh::Locate(const Vertex& point) const
+{
+    return locator.locate(point, [&](uint32_t cuboid, const Vertex& p) {
+        return boxes[cuboid].contains(p);
+    });
+}
+
+void Mesh::Locate(std::span<const Vertex> points, std::span<uint32_t> cuboid_ids, unsigned num_threads) const
+{
+    assert(points.size() == cuboid_ids.size());
+    parallelFor(points.size(), [&](size_t i) { cuboid_ids[i] = Locate(points[i]); }, num_threads);
+}
+
+void Mesh::RebuildLocator()
+{
+    locator.build(boxes);
+}
+
+void Mesh::CompactSubFaceTrees()
+{
+    sft.compact(F2f);
+}
+
+void Mesh::EnableVertexHash(bool enable)
+{
+    use_vertex_hash = enable;
+    if (enable) vertex_hash.build(vertices, lattice);
+    else vertex_hash.clear();
+}
+
+void Mesh::EnableHistory(bool enable)
+{
+    track_history = enable;
+    history.reset(enable ? cuboids.size() : 0);
+}
+
+MeshPermutation Mesh::Reorder(CurveOrder order, unsigned num_threads)
+{
+    // Sort the ids on their curve key, ties keep the old order so the result is deterministic
+    const auto sortedIds = [&](size_t count, auto&& position) {
+        std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+        parallelFor(count, [&](size_t i) { keys[i] = { curveKey(position(i), order), static_cast<uint32_t>(i) }; }, num_threads);
+        parallelSort(keys.begin(), keys.end(), std::less<>(), num_threads);
+        std::vector<uint32_t> new_ids(count);
+        parallelFor(count, [&](size_t i) { new_ids[keys[i].second] = static_cast<uint32_t>(i); }, num_threads);
+        return new_ids;
+    };
+    MeshPermutation permutation;
+    permutation.cuboids = sortedIds(cuboids.size(), [&](size_t c) { return boxes[c].center(); });
+    permutation.vertices = sortedIds(vertices.size(), [&](size_t v) { return vertices[v]; });
+    const auto& new_cuboid = permutation.cuboids;
+    const auto& new_vertex = permutation.vertices;
+    // Subface tree references are node ids and stay the same
+    const auto remap = [&](const halfFace hf) {
+        if (hf.isBorder() || hf.isSubdivided()) return hf;
+        return halfFace(new_cuboid[hf.getCuboid()], hf.getLocalId());
+    };
+
+    std::vector<Cuboid> new_cuboids(cuboids.size());
+    std::vector<Box> new_boxes(boxes.size());
+    std::vector<halfFace> new_F2f(F2f.size(), halfFace(border_id));
+    parallelFor(cuboids.size(), [&](size_t c) {
+        const uint32_t to = new_cuboid[c];
+        for (uint8_t i = 0; i < 8; i++) new_cuboids[to].vertices[i] = new_vertex[cuboids[c].vertices[i]];
+        new_boxes[to] = boxes[c];
+        for (uint8_t i = 0; i < 6; i++) {
+            const halfFace twin = F2f[c * 6 + i];
+            new_F2f[static_cast<size_t>(to) * 6 + i] = remap(twin);
+            if (!twin.isSubdivided()) continue;
+            // Every tree has one owner, so the trees can be remapped concurrently. Free nodes are not reachable and left as they are
+            std::vector<uint32_t> stack = { SubFaceTree::toNodeIndex(twin) };
+            while (!stack.empty()) {
+                Node& node = sft.nodes[stack.back()];
+                stack.pop_back();
+                node.parent = remap(node.parent);
+                for (halfFace* child : { &node.lower_child, &node.top_child }) {
+                    if (child->isSubdivided()) stack.push_back(SubFaceTree::toNodeIndex(*child));
+                    else *child = remap(*child);
+                }
+            }
+        }
+    }, num_threads);
+
+    VertexStore new_vertices;
+    new_vertices.resize(vertices.size());
+    std::vector<localVertex> new_V2lV(V2lV.size(), localVertex(0, 0));
+    parallelFor(vertices.size(), [&](size_t v) {
+        new_vertices.set(new_vertex[v], vertices[v]);
+        new_V2lV[new_vertex[v]] = localVertex(new_cuboid[V2lV[v].getCuboid()], V2lV[v].getLocalId());
+    }, num_threads);
+
+    cuboids = std::move(new_cuboids);
+    boxes = std::move(new_boxes);
+    F2f = std::move(new_F2f);
+    vertices = std::move(new_vertices);
+    V2lV = std::move(new_V2lV);
+    RebuildLocator();
+    if (use_vertex_hash) vertex_hash.build(vertices, lattice);
+    if (track_history) history.renumber(new_cuboid);
+    star_valid = false;
+    dual_graph_valid = false;
+    return permutation;
+}
+
+void Mesh::validateFace(const halfFace hf, std::vector<Violation>& found) const
+{
+    constexpr uint32_t none = static_cast<uint32_t>(-1);
+    const uint8_t face = hf.getLocalId();
+    const Axis axis = Hf2Ax[face];
+    const bool top = face == 1 || face == 2 || face == 3;
+    // The face as a flat box
+    Box region = boxes[hf.getCuboid()];
+    const float plane = top ? axisCoord(region.max, axis) : axisCoord(region.min, axis);
+    axisCoord(region.min, axis) = plane;
+    axisCoord(region.max, axis) = plane;
+    const auto inside = [&](const Box& inner, const Box& outer) {
+        for (const Axis a : { Axis::x, Axis::y, Axis::z }) {
+            if (a == axis) continue;
+            if (!lattice.atMost(axisCoord(outer.min, a), axisCoord(inner.min, a)) || !lattice.atMost(axisCoord(inner.max, a), axisCoord(outer.max, a))) return false;
+        }
+        return true;
+    };
+    // A neighbour covering part of the face, the part it covers is leaf_region
+    const auto checkNeighbour = [&](const halfFace neighbour, const Box& leaf_region) {
+        if (neighbour.isBorder() || neighbour.getCuboid() >= cuboids.size() || neighbour.getLocalId() != opposite_face(face)) {
+            found.push_back({ MeshViolation::twin, hf.id, neighbour.id });
+            return;
+        }
+        const Box& other = boxes[neighbour.getCuboid()];
+        const float other_plane = top ? axisCoord(other.min, axis) : axisCoord(other.max, axis);
+        if (!lattice.same(plane, other_plane) || !inside(leaf_region, other)) {
+            found.push_back({ MeshViolation::coverage, hf.id, neighbour.id });
+            return;
+        }
+        const halfFace back = Twin(neighbour);
+        if (back == hf) return;
+        if (!back.isSubdivided() || SubFaceTree::toNodeIndex(back) >= sft.nodes.size() || !(*sft.find(back, leaf_region.center()) == hf)) {
+            found.push_back({ MeshViolation::twin, hf.id, neighbour.id });
+        }
+    };
+
+    const halfFace twin = Twin(hf);
+    if (twin.isBorder()) {
+        if (!lattice.same(plane, top ? 1.0f : 0.0f)) found.push_back({ MeshViolation::coverage, hf.id, none });
+        return;
+    }
+    if (!twin.isSubdivided()) {
+        checkNeighbour(twin, region);
+        return;
+    }
+    const uint32_t root = SubFaceTree::toNodeIndex(twin);
+    if (root >= sft.nodes.size() || !(sft.nodes[root].parent == hf)) {
+        found.push_back({ MeshViolation::subface_tree, root, hf.id });
+        return;
+    }
+    // Walk the tree, tracking the part of the face below every node. Bounded by the number of nodes in case of a cycle
+    std::vector<std::pair<uint32_t, Box>> stack = { { root, region } };
+    size_t visited = 0;
+    while (!stack.empty() && visited++ < sft.nodes.size()) {
+        const auto [node_index, node_region] = stack.back();
+        stack.pop_back();
+        const Node& node = sft.nodes[node_index];
+        const float lo = axisCoord(node_region.min, node.getSplitAxis()), hi = axisCoord(node_region.max, node.getSplitAxis());
+        if (node.getSplitAxis() == axis || !lattice.below(lo, node.getSplitCoord()) || !lattice.below(node.getSplitCoord(), hi)) {
+            found.push_back({ MeshViolation::subface_tree, node_index, hf.id });
+            continue;
+        }
+        Box lower_region = node_region, top_region = node_region;
+        axisCoord(lower_region.max, node.getSplitAxis()) = node.getSplitCoord();
+        axisCoord(top_region.min, node.getSplitAxis()) = node.getSplitCoord();
+        for (uint8_t side = 6; side < 8; side++) {
+            const halfFace child = side == 6 ? node.lower_child : node.top_child;
+            const Box& child_region = side == 6 ? lower_region : top_region;
+            if (!child.isSubdivided()) {
+                checkNeighbour(child, child_region);
+                continue;
+            }
+            const uint32_t child_index = SubFaceTree::toNodeIndex(child);
+            if (child_index >= sft.nodes.size() || !(sft.nodes[child_index].parent == halfFace(node_index, side))) {
+                found.push_back({ MeshViolation::subface_tree, node_index, child.id });
+                continue;
+            }
+            stack.push_back({ child_index, child_region });
+        }
+    }
+    if (!stack.empty()) found.push_back({ MeshViolation::subface_tree, root, hf.id });
+}
+
+ValidationReport Mesh::Validate(const ValidateOptions& options) const
+{
+    constexpr uint32_t none = static_cast<uint32_t>(-1);
+    std::vector<std::vector<Violation>> found(numThreads(options.num_threads));
+    if (options.check_faces) {
+        parallelChunks(cuboids.size(), [&](unsigned t, size_t first, size_t last) {
+            for (size_t c = first; c < last; c++) {
+                for (uint8_t face = 0; face < 6; face++) validateFace(halfFace(c, face), found[t]);
+            }
+        }, options.num_threads, 256);
+    }
+    if (options.check_vertices) {
+        parallelChunks(V2lV.size(), [&](unsigned t, size_t first, size_t last) {
+            for (size_t v = first; v < last; v++) {
+                const localVertex lv = V2lV[v];
+                if (lv.getCuboid() >= cuboids.size() || cuboids[lv.getCuboid()].vertices[lv.getLocalId()] != v) {
+                    found[t].push_back({ MeshViolation::vertex_map, static_cast<uint32_t>(v), lv.id });
+                }
+            }
+        }, options.num_threads);
+        if (V2lV.size() != vertices.size()) found[0].push_back({ MeshViolation::vertex_map, static_cast<uint32_t>(std::min(V2lV.size(), vertices.size())), none });
+        parallelChunks(cuboids.size(), [&](unsigned t, size_t first, size_t last) {
+            for (size_t c = first; c < last; c++) {
+                for (uint8_t i = 0; i < 8; i++) {
+                    // Local vertices 1, 2, 5, 6 are at the top in x, 2, 3, 6, 7 in y and 4 to 7 in z
+                    const bool top_x = i == 1 || i == 2 || i == 5 || i == 6;
+                    const bool top_y = i == 2 || i == 3 || i == 6 || i == 7;
+                    const Vertex corner = { top_x ? boxes[c].max.x : boxes[c].min.x, top_y ? boxes[c].max.y : boxes[c].min.y, i >= 4 ? boxes[c].max.z : boxes[c].min.z };
+                    const uint32_t v = cuboids[c].vertices[i];
+                    if (v >= vertices.size() || !lattice.sameVertex(vertices[v], corner)) {
+                        found[t].push_back({ MeshViolation::corner_position, static_cast<uint32_t>(c), v });
+                    }
+                }
+            }
+        }, options.num_threads);
+        // Every vertex lies in the unit cube. Counting is one pass over the coordinate arrays, the vertices outside are
+        // only located when the count misses some
+        const float tolerance = lattice.tolerance();
+        const Box domain{ { -tolerance, -tolerance, -tolerance }, { 1.0f + tolerance, 1.0f + tolerance, 1.0f + tolerance } };
+        if (vertices.countInBox(domain) != vertices.size()) {
+            std::vector<uint8_t> outside(vertices.size(), 0);
+            std::vector<int8_t> sides;
+            for (const Axis axis : { Axis::x, Axis::y, Axis::z }) {
+                vertices.classify(axis, 0.0f, tolerance, sides);
+                for (size_t v = 0; v < sides.size(); v++) outside[v] |= sides[v] < 0;
+                vertices.classify(axis, 1.0f, tolerance, sides);
+                for (size_t v = 0; v < sides.size(); v++) outside[v] |= sides[v] > 0;
+            }
+            for (size_t v = 0; v < outside.size(); v++) {
+                if (outside[v]) found[0].push_back({ MeshViolation::outside_domain, static_cast<uint32_t>(v), none });
+            }
+        }
+    }
+    if (options.check_duplicates) {
+        std::vector<uint32_t> order(vertices.size());
+        std::iota(order.begin(), order.end(), 0);
+        const auto less = [&](uint32_t a, uint32_t b) {
+            return std::make_tuple(vertices.x(a), vertices.y(a), vertices.z(a), a) < std::make_tuple(vertices.x(b), vertices.y(b), vertices.z(b), b);
+        };
+        parallelSort(order.begin(), order.end(), less, options.num_threads);
+        parallelChunks(order.size() > 0 ? order.size() - 1 : 0, [&](unsigned t, size_t first, size_t last) {
+            for (size_t i = first; i < last; i++) {
+                if (lattice.sameVertex(vertices[order[i]], vertices[order[i + 1]])) {
+                    found[t].push_back({ MeshViolation::duplicate_vertex, std::min(order[i], order[i + 1]), std::max(order[i], order[i + 1]) });
+                }
+            }
+        }, options.num_threads);
+    }
+
+    ValidationReport report;
+    for (auto& thread_found : found) {
+        for (const auto& violation : thread_found) report.counts[static_cast<size_t>(violation.kind)]++;
+        report.violations.insert(report.violations.end(), thread_found.begin(), thread_found.end());
+    }
+    const auto by_kind = [](const Violation& a, const Violation& b) { return std::tie(a.kind, a.id, a.other) < std::tie(b.kind, b.id, b.other); };
+    const size_t reported = std::min(options.max_reported, report.violations.size());
+    std::partial_sort(report.violations.begin(), report.violations.begin() + reported, report.violations.end(), by_kind);
+    report.violations.resize(reported);
+    return report;
+}
+
+void Mesh::replaceTwin(const halfFace neighbour, const halfFace old_hf, const halfFace new_hf)
+{
+    if (!Twin(neighbour).isSubdivided()) {
+        Twin(neighbour) = new_hf;
+        return;
+    }
+    for (auto it = sft.begin(Twin(neighbour)); it != sft.end(); ++it) {
+        if (*it == old_hf) {
+            *it = new_hf;
+            return;
+        }
+    }
+    assert(false);
+}
+
+void Mesh::moveHalfFace(const halfFace from, const halfFace to)
+{
+    const halfFace twin = Twin(from);
+    Twin(to) = twin;
+    if (twin.isBorder()) return;
+    if (twin.isSubdivided()) {
+        sft.updateParent(twin, to);
+        for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) {
+            replaceTwin(*it, from, to);
+        }
+    }
+    else {
+        replaceTwin(twin, from, to);
+    }
+}
+
+void Mesh::moveCuboid(uint32_t from, uint32_t to)
+{
+    cuboids[to] = cuboids[from];
+    boxes[to] = boxes[from];
+    for (uint8_t i = 0; i < 6; i++) {
+        moveHalfFace(halfFace(from, i), halfFace(to, i));
+    }
+    for (const auto v : cuboids[to].vertices) {
+        if (V2lV[v].getCuboid() == from) V2lV[v] = localVertex(to, V2lV[v].getLocalId());
+    }
+}
+
+std::array<uint32_t, 8> Mesh::cuboidsAroundPoint(const Vertex& p) const
+{
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    std::array<uint32_t, 8> found;
+    for (uint8_t octant = 0; octant < 8; octant++) {
+        const Vertex q = { std::nextafter(p.x, octant & 1 ? inf : -inf), std::nextafter(p.y, octant & 2 ? inf : -inf), std::nextafter(p.z, octant & 4 ? inf : -inf) };
+        found[octant] = Locate(q);
+    }
+    return found;
+}
+
+std::array<uint32_t, 8> Mesh::cuboidsAtVertex(uint32_t v) const
+{
+    // Every cuboid with a corner at v contains exactly one of the points just next to v
+    auto found = cuboidsAroundPoint(vertices[v]);
+    for (auto& cuboid : found) {
+        const bool corner = cuboid != static_cast<uint32_t>(-1) && std::find(cuboids[cuboid].vertices.begin(), cuboids[cuboid].vertices.end(), v) != cuboids[cuboid].vertices.end();
+        if (!corner) cuboid = static_cast<uint32_t>(-1);
+    }
+    return found;
+}
+
+RemovedId Mesh::removeVertex(uint32_t v)
+{
+    const uint32_t last = vertices.size() - 1;
+    if (use_vertex_hash) {
+        vertex_hash.erase(v, vertices[v]);
+        if (v != last) {
+            vertex_hash.erase(last, vertices[last]);
+            vertex_hash.insert(v, vertices[last]);
+        }
+    }
+    if (v != last) {
+        // Move the last vertex into the free id
+        for (const auto cuboid : cuboidsAtVertex(last)) {
+            if (cuboid == static_cast<uint32_t>(-1)) continue;
+            std::replace(cuboids[cuboid].vertices.begin(), cuboids[cuboid].vertices.end(), last, v);
+        }
+        vertices.set(v, vertices[last]);
+        V2lV[v] = V2lV[last];
+    }
+    vertices.resize(last);
+    V2lV.resize(last, localVertex(0, 0));
+    return { v, last };
+}
+
+halfFace Mesh::buildFaceTree(std::span<uint32_t> neighbours, uint8_t face, halfFace parent, bool commit)
+{
+    if (neighbours.size() == 1) return halfFace(neighbours[0], face);
+    Axis axis = Axis::x;
+    float coordinate = 0.0f;
+    const size_t num_lower = PointLocator::findCut(neighbours, boxes, axis, coordinate);
+    if (num_lower == 0) return halfFace(border_id);
+    uint32_t node_index = 0;
+    if (commit) node_index = sft.insertNode({ parent, coordinate, axis, halfFace(border_id), halfFace(border_id) });
+    const halfFace lower = buildFaceTree(neighbours.subspan(0, num_lower), face, halfFace(node_index, 6), commit);
+    const halfFace top = buildFaceTree(neighbours.subspan(num_lower), face, halfFace(node_index, 7), commit);
+    if (lower.isBorder() || top.isBorder()) return halfFace(border_id);
+    if (commit) {
+        sft.nodes[node_index].lower_child = lower;
+        sft.nodes[node_index].top_child = top;
+    }
+    return halfFace(node_index, 6);
+}
+
+MergeResult Mesh::Merge(uint32_t cuboid_a, uint32_t cuboid_b)
+{
+    if (cuboid_a == cuboid_b || cuboid_a >= cuboids.size() || cuboid_b >= cuboids.size()) return {};
+    // Find the common face, lo is below it and hi above it
+    uint32_t lo = -1, hi = -1;
+    uint8_t top_face = 0;
+    for (const uint8_t face : { 3, 2, 1 }) {
+        const uint8_t bottom_face = opposite_face(face);
+        if (Twin(halfFace(cuboid_a, face)) == halfFace(cuboid_b, bottom_face) && Twin(halfFace(cuboid_b, bottom_face)) == halfFace(cuboid_a, face)) {
+            lo = cuboid_a; hi = cuboid_b; top_face = face;
+        }
+        else if (Twin(halfFace(cuboid_b, face)) == halfFace(cuboid_a, bottom_face) && Twin(halfFace(cuboid_a, bottom_face)) == halfFace(cuboid_b, face)) {
+            lo = cuboid_b; hi = cuboid_a; top_face = face;
+        }
+    }
+    if (lo == static_cast<uint32_t>(-1)) return {};
+    const uint8_t bottom_face = opposite_face(top_face);
+    const Axis axis = Hf2Ax[top_face];
+
+    // Plan the side faces before changing anything
+    struct SideNeighbour {
+        halfFace face;
+        // Where lo and hi are in the subface tree of the neighbour, border if they are not
+        halfFace lo_slot, hi_slot;
+    };
+    std::array<std::vector<SideNeighbour>, 6> side_neighbours;
+    std::array<std::vector<uint32_t>, 6> side_cuboids;
+    for (uint8_t face = 0; face < 6; face++) {
+        if (face == top_face || face == bottom_face) continue;
+        const halfFace lo_twin = Twin(halfFace(lo, face));
+        const halfFace hi_twin = Twin(halfFace(hi, face));
+        if (lo_twin.isBorder() != hi_twin.isBorder()) return {};
+        if (lo_twin.isBorder()) continue;
+        // The distinct neighbours of both halves
+        auto& neighbours = side_cuboids[face];
+        for (const auto twin : { lo_twin, hi_twin }) {
+            if (!twin.isSubdivided()) {
+                neighbours.push_back(twin.getCuboid());
+                continue;
+            }
+            for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) neighbours.push_back((*it).getCuboid());
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (const auto cuboid : neighbours) {
+            SideNeighbour neighbour = { halfFace(cuboid, opposite_face(face)), halfFace(border_id), halfFace(border_id) };
+            const halfFace twin = Twin(neighbour.face);
+            if (twin.isSubdivided()) {
+                for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) {
+                    if (*it == halfFace(lo, face)) neighbour.lo_slot = it.toIndex();
+                    if (*it == halfFace(hi, face)) neighbour.hi_slot = it.toIndex();
+                }
+                // A neighbour covering parts of both halves needs them as the two children of one node
+                if (!neighbour.lo_slot.isBorder() && !neighbour.hi_slot.isBorder()) {
+                    const uint32_t node_index = SubFaceTree::toNodeIndex(neighbour.lo_slot);
+                    if (!(neighbour.lo_slot == halfFace(node_index, 6)) || !(neighbour.hi_slot == halfFace(node_index, 7)) || sft.nodes[node_index].getSplitAxis() != axis) return {};
+                }
+            }
+            side_neighbours[face].push_back(neighbour);
+        }
+        // The merged face has to be divisible into the neighbours by cuts
+        if (buildFaceTree(neighbours, opposite_face(face), halfFace(border_id), false).isBorder()) return {};
+    }
+
+    const uint32_t keep = std::min(lo, hi);
+    const uint32_t removed = std::max(lo, hi);
+    MergeResult result;
+    result.cuboid = keep;
+    for (uint8_t face = 0; face < 6; face++) {
+        if (face == top_face || face == bottom_face) continue;
+        const halfFace merged(keep, face);
+        // Point the neighbours to the merged face
+        for (const auto& neighbour : side_neighbours[face]) {
+            if (neighbour.lo_slot.isBorder() && neighbour.hi_slot.isBorder()) {
+                Twin(neighbour.face) = merged;
+            }
+            else if (!neighbour.lo_slot.isBorder() && !neighbour.hi_slot.isBorder()) {
+                // Replace the node of the two halves by a single leaf
+                const uint32_t node_index = SubFaceTree::toNodeIndex(neighbour.lo_slot);
+                const halfFace parent = sft.nodes[node_index].parent;
+                if (parent.isSubdivided()) {
+                    Node& parent_node = sft.nodes[SubFaceTree::toNodeIndex(parent)];
+                    (isHigher(parent) ? parent_node.top_child : parent_node.lower_child) = merged;
+                }
+                else {
+                    Twin(neighbour.face) = merged;
+                }
+                sft.removeNode(node_index);
+            }
+            else {
+                const halfFace slot = neighbour.lo_slot.isBorder() ? neighbour.hi_slot : neighbour.lo_slot;
+                Node& node = sft.nodes[SubFaceTree::toNodeIndex(slot)];
+                (isHigher(slot) ? node.top_child : node.lower_child) = merged;
+            }
+        }
+        // Free the subface trees of both halves and build the tree of the merged face
+        for (const auto twin : { Twin(halfFace(lo, face)), Twin(halfFace(hi, face)) }) {
+            if (!twin.isSubdivided()) continue;
+            std::vector<uint32_t> stack = { SubFaceTree::toNodeIndex(twin) };
+            while (!stack.empty()) {
+                const uint32_t node_index = stack.back();
+                stack.pop_back();
+                if (sft.nodes[node_index].lower_child.isSubdivided()) stack.push_back(SubFaceTree::toNodeIndex(sft.nodes[node_index].lower_child));
+                if (sft.nodes[node_index].top_child.isSubdivided()) stack.push_back(SubFaceTree::toNodeIndex(sft.nodes[node_index].top_child));
+                sft.removeNode(node_index);
+            }
+        }
+        Twin(merged) = side_cuboids[face].empty() ? halfFace(border_id) : buildFaceTree(side_cuboids[face], opposite_face(face), merged, true);
+    }
+
+    // The merged cuboid takes the outer face of the removed half
+    std::array<uint32_t, 4> middle_vertices;
+    for (size_t i = 0; i < 4; i++) middle_vertices[i] = cuboids[lo].vertices[Hf2Ve[top_face][i]];
+    const uint8_t outer_face = keep == lo ? top_face : bottom_face;
+    moveHalfFace(halfFace(removed, outer_face), halfFace(keep, outer_face));
+    for (const auto lv : Hf2Ve[outer_face]) {
+        const uint32_t v = cuboids[removed].vertices[lv];
+        cuboids[keep].vertices[lv] = v;
+        if (V2lV[v].getCuboid() == removed) V2lV[v] = localVertex(keep, lv);
+    }
+    const Vertex lo_middle = boxes[lo].center();
+    axisCoord(boxes[keep].min, axis) = axisCoord(boxes[lo].min, axis);
+    axisCoord(boxes[keep].max, axis) = axisCoord(boxes[hi].max, axis);
+
+    const bool locator_merged = locator.merge(lo, hi, keep, lo_middle);
+    if (track_history) history.merge(keep, removed);
+    // Move the last cuboid into the removed id
+    const uint32_t last = cuboids.size() - 1;
+    result.removed_cuboid = { removed, last };
+    if (removed != last) {
+        moveCuboid(last, removed);
+        if (locator_merged) locator.rename(last, removed);
+        if (track_history) history.rename(last, removed);
+    }
+    if (track_history) history.truncate(last);
+    cuboids.resize(last);
+    boxes.resize(last);
+    F2f.resize(F2f.size() - 6, halfFace(border_id));
+    if (locator_merged) locator.truncate(last);
+    else RebuildLocator();
+
+    // The vertices in the middle are removed unless another cuboid still has them as a corner
+    std::sort(middle_vertices.begin(), middle_vertices.end(), std::greater<uint32_t>());
+    for (const auto v : middle_vertices) {
+        const auto owners = cuboidsAtVertex(v);
+        const auto owner = std::find_if(owners.begin(), owners.end(), [](uint32_t c) { return c != static_cast<uint32_t>(-1); });
+        if (owner == owners.end()) {
+            result.removed_vertices.push_back(removeVertex(v));
+            continue;
+        }
+        const auto& corners = cuboids[*owner].vertices;
+        V2lV[v] = localVertex(*owner, std::distance(corners.begin(), std::find(corners.begin(), corners.end(), v)));
+    }
+    star_valid = false;
+    dual_graph_valid = false;
+    return result;
+}
@@ -7,8 +7,17 @@
 #include <string>
 #include <fstream>
 #include <algorithm>
+#include <span>
 #include "Types.hpp"
 #include "SubFaceTree.hpp"
+#include "VertexStore.hpp"
+#include "PointLocator.hpp"
+#include "VertexHash.hpp"
+#include "VertexStar.hpp"
+#include "DualGraph.hpp"
+#include "SpaceFillingCurve.hpp"
+#include "MeshValidation.hpp"
+#include "RefinementHistory.hpp"
 
 /*
 * local Half face id to vertex id
@@ -63,19 +72,69 @@ static constexpr std::array<std::array<std::array<uint8_t, 2>, 4>, 3> Hfs2Check
     {{ {5,4}, {4,3}, {3,2}, {2,5} }}
 }};
 
+/*
+* Renumbering of a mesh, the new id of every old cuboid and vertex id
+*/
+struct MeshPermutation
+{
+    std::vector<uint32_t> cuboids;
+    std::vector<uint32_t> vertices;
+};
+
+/*
+* An id given up to keep the ids compact: the object with id removed is gone and the last object, with id last, takes its id.
+* Data stored per id outside the mesh follows with data[removed] = data[last]; data.pop_back(); removed == last if the last object was removed.
+*/
+struct RemovedId
+{
+    uint32_t removed;
+    uint32_t last;
+};
+
+/*
+* Outcome of Mesh::Merge, with the renumbering it caused
+*/
+struct MergeResult
+{
+    // The merged cuboid, -1 if the cuboids could not be merged and the mesh is unchanged
+    uint32_t cuboid = static_cast<uint32_t>(-1);
+    // The cuboid id given up by the merge
+    RemovedId removed_cuboid = { static_cast<uint32_t>(-1), static_cast<uint32_t>(-1) };
+    // The vertices of the common face no cuboid uses anymore, to be applied in order
+    std::vector<RemovedId> removed_vertices;
+    bool merged() const { return cuboid != static_cast<uint32_t>(-1); }
+};
 
 class Mesh 
 {
 
 private:
     /* data */
-    std::vector<Vertex> vertices;
+    VertexStore vertices;
     std::vector<Cuboid> cuboids;
+    // Bounding box of every cuboid, kept next to the cuboids so geometric passes do not need to look up vertices
+    std::vector<Box> boxes;
     // Stores a mapping of Half faces to twin half faces
     std::vector<halfFace> F2f;
     // Map vertex IDs to a local vertex within an element that contains the vertex
     std::vector<localVertex> V2lV;
     SubFaceTree sft;
+    // Coordinate lattice, all split points are snapped to it when enabled
+    Lattice lattice;
+    // Spatial index to find the cuboid containing a point
+    PointLocator locator;
+    // Optional hash of the vertex positions, when enabled splits look up existing vertices in it instead of in the subface trees
+    VertexHash vertex_hash;
+    bool use_vertex_hash = false;
+    // Optional record of all splits and merges
+    RefinementHistory history;
+    bool track_history = false;
+    // Cuboids around every vertex, rebuilt on first use after the mesh changed
+    mutable VertexStar star;
+    mutable bool star_valid = false;
+    // Face adjacency graph of the cuboids, rebuilt on first use after the mesh changed
+    mutable DualGraph dual_graph;
+    mutable bool dual_graph_valid = false;
 
     /*
     * Split a halfFace in two, divide subhalfFaces and update all twins
@@ -92,8 +151,108 @@ private:
     */
     void updateTwin(const halfFace twin, const halfFace old_hf, const halfFace new_hf, const Vertex& middle);
 
+    /*
+    * Reserve storage for a number of upcoming splits, grows geometrically so repeated small batches stay amortized
+    */
+    void reserveSplits(size_t num_splits);
+
+    /*
+    * Everything a split needs that can be computed without modifying the mesh
+    */
+    struct PreparedSplit {
+        uint32_t cuboid_id;
+        Axis axis;
+        uint8_t face_to_split;
+        Vertex middle;
+        std::array<Vertex, 4> v_new;
+        // Id of an existing vertex to reuse, or border_id if the vertex has to be created
+        std::array<uint32_t, 4> vertex_inds;
+        uint32_t numNewVertices() const { return static_cast<uint32_t>(std::count(vertex_inds.begin(), vertex_inds.end(), border_id)); }
+    };
+
+    /*
+    * Check a split and look up the vertices it can reuse, returns false if the split point is not inside the cuboid.
+    * Without find_vertices the vertex ids are left for the caller to fill in.
+    * Only reads the mesh, so it is safe to call concurrently.
+    */
+    bool prepareSplit(uint32_t cuboid_id, float split_point, Axis axis, PreparedSplit& split, bool find_vertices = true) const;
+
+    /*
+    * Id of an existing vertex at the i-th new vertex of a prepared split, border_id if there is none
+    */
+    uint32_t findSplitVertex(const PreparedSplit& split, size_t i) const;
+
+    /*
+    * Write the new cuboid, its halfFaces and its new vertices at the given, already allocated, ids.
+    * Only touches the split cuboid and its own vertices, so splits without common vertices can be committed concurrently.
+    */
+    void commitSplit(const PreparedSplit& split, uint32_t new_cuboid_id, uint32_t first_new_vertex);
+
+    /*
+    * Update the twins and subface trees of the neighbours of a committed split
+    */
+    void linkSplit(const PreparedSplit& split, uint32_t new_cuboid_id);
+
+    /*
+    * Split a cuboid into the cells of a grid, lines holds the increasing, snapped grid lines along every axis including the sides
+    * of the cuboid. All children are allocated at once and the vertices created by earlier splits of the grid are taken from it
+    * instead of searching the subface trees for them. Returns the children with cell (i, j, k) at index i + j * nx + k * nx * ny.
+    */
+    std::vector<uint32_t> splitGrid(uint32_t cuboid_id, const std::array<std::vector<float>, 3>& lines);
+
+    /*
+    * Write the six halfFaces of a new cuboid, split off cuboid_id
+    */
+    void writeHalfFaces(const uint32_t cuboid_id, const uint32_t new_cuboid_id, const Axis split_axis);
+    // Rebuild the mesh from the unit cube such that it consists of the target boxes
+    void rebuildFromBoxes(std::span<const Box> targets);
+
+    /*
+    * Replace old_hf by new_hf as the twin of neighbour, or as a leaf in the subface tree of neighbour
+    */
+    void replaceTwin(const halfFace neighbour, const halfFace old_hf, const halfFace new_hf);
+
+    /*
+    * Give the twin of halfFace from to the unused halfFace to and point all its neighbours to it
+    */
+    void moveHalfFace(const halfFace from, const halfFace to);
+
+    /*
+    * Move cuboid from to the unused id to, updating all references to it
+    */
+    void moveCuboid(uint32_t from, uint32_t to);
+
+    /*
+    * The cuboids in the eight octants just next to point p, -1 for octants outside the mesh
+    */
+    std::array<uint32_t, 8> cuboidsAroundPoint(const Vertex& p) const;
+
+    /*
+    * The cuboids having vertex v as a corner, one entry per octant around v, -1 if the cuboid in that octant does not use v
+    */
+    std::array<uint32_t, 8> cuboidsAtVertex(uint32_t v) const;
+
+    /*
+    * Remove a vertex no cuboid uses anymore, the last vertex is moved into its id
+    */
+    RemovedId removeVertex(uint32_t v);
+
+    /*
+    * Build a subface tree over the neighbour cuboids touching a face with their halfFace face, by cuts between them.
+    * Only checks that such a tree exists if commit is not set. Returns the head of the tree, border_id if there is no such tree.
+    */
+    halfFace buildFaceTree(std::span<uint32_t> neighbours, uint8_t face, halfFace parent, bool commit);
+
+    /*
+    * Check the twin, subface tree and coverage of one halfFace for Validate, appends the violations to found
+    */
+    void validateFace(const halfFace hf, std::vector<Violation>& found) const;
+
 public:
 
+    // Id returned for splits that were not applied
+    static constexpr uint32_t no_cuboid = static_cast<uint32_t>(-1);
+
     /* Static helper functions */
     static constexpr uint8_t opposite_face(uint8_t local_id) {
         switch (local_id & 0x7)
@@ -112,16 +271,57 @@ public:
     /**
     * Getters for the private vectors to access them publicly via the Mesh class.
     */
-    const std::vector<Vertex>& getVertices() const;
+    const VertexStore& getVertices() const;
     const std::vector<Cuboid>& getCuboids() const;
+    const std::vector<Box>& getBoxes() const;
     const std::vector<halfFace>& getF2f() const;
     const std::vector<localVertex>& getV2lV() const;
     const SubFaceTree& getSft() const;
+    const Lattice& getLattice() const;
+    const PointLocator& getLocator() const;
+
+    /*
+    * The cuboids touching every vertex, including the cuboids on which it is a hanging vertex.
+    * Built in parallel on first use after the mesh changed, so it must not be called concurrently with itself or with changes to the mesh.
+    */
+    const VertexStar& getVertexStar() const;
+
+    /*
+    * The cuboids sharing part of a face with every cuboid, weighted by the shared area.
+    * Built in parallel on first use after the mesh changed, with the same restrictions as getVertexStar.
+    */
+    const DualGraph& getDualGraph() const;
+
+    /*
+    * Build the parts of the mesh that are built on first use, the vertex star and the dual graph, and thread the leaves of the
+    * subface trees changed by single splits and merges. Afterwards every const member can be called concurrently, until the mesh changes.
+    */
+    void prepareForConcurrentReads();
 
     /*
     * Saves the mesh structure in a .ply file format to be used to visualize the mesh
+    * Writes a binary little endian file if binary is set, otherwise text. With unique_faces a face shared by two cuboids is written once.
+    * Besides the faces the file contains a "cuboid" element with the 8 vertex indices of every cuboid, which is used by Load.
+    */
+    void Save(const std::string& filename, bool binary = false, bool unique_faces = false);
+
+    /*
+    * Replace this mesh by the mesh in a .ply file, from the "cuboid" element or from six faces per cuboid as written by Save.
+    * The mesh is rebuilt by splitting the unit cube, so cuboid and vertex ids follow that order and not the file.
+    * Throws a std::runtime_error if the cuboids do not fill the unit cube or cannot be obtained by splitting.
+    */
+    void Load(const std::string& filename);
+
+    /*
+    * Saves the complete mesh state in a binary snapshot, see MeshSnapshot.hpp for the format
     */
-    void Save(const std::string& filename);
+    void SaveSnapshot(const std::string& filename) const;
+
+    /*
+    * Replace this mesh by the mesh in a snapshot written by SaveSnapshot, throws a std::runtime_error if the file is invalid.
+    * Use MeshView to read a snapshot without copying it.
+    */
+    void LoadSnapshot(const std::string& filename);
 
     /**
      * Returns a reference to the twin half face of the given half face "hf"
@@ -134,7 +334,7 @@ public:
     const halfFace& Twin(const halfFace& hf) const;
 
     /* 
-     * Note not an efficient function, used only for testing purposes
+     * Note not an efficient function, used only for testing purposes, use getDualGraph().adjacent instead
      * Tests wether two elements are directly adjacent, that is touch at a face
      */
     bool Adjacent(uint32_t elem1, uint32_t elem2) const;
@@ -142,7 +342,7 @@ public:
     /*
     * A simpler generalized find vertex method, finds a vertex on the border of a face, checks all three required elements for the vertex
     */
-    std::pair<bool, uint32_t> mergeVertexIfExists(const Vertex& v, HalfFacePair hftoCheck, uint8_t local_id, Axis split_axis);
+    std::pair<bool, uint32_t> mergeVertexIfExists(const Vertex& v, HalfFacePair hftoCheck, uint8_t local_id, Axis split_axis) const;
 
     /**
      * Add function which pushes the new half and twin half faces of the new cuboid in vector F2F
@@ -170,11 +370,109 @@ public:
     */
     uint32_t SplitAlongXZ(uint32_t cuboid_id, float y_split);
 
+    /**
+     * Split a cuboid into slabs along an axis at all the given planes in one call.
+     * Planes outside the cuboid, or on the same coordinate as a lower plane after snapping to the lattice, are skipped.
+     * Returns the ids of the slabs that were created ordered along the axis, the first one is cuboid_id.
+    */
+    std::vector<uint32_t> SplitAlongAxisMulti(uint32_t cuboid_id, Axis axis, std::span<const float> planes);
+
+    /**
+     * Uniformly subdivide a cuboid into nx * ny * nz cuboids, e.g. Subdivide(id, 2, 2, 2) splits it into eighths.
+     * Returns the ids of the children with child (i, j, k) at index i + j * nx + k * nx * ny, the first one is cuboid_id.
+     * Returns an empty vector and leaves the mesh unchanged if a plane would not cut, e.g. because two planes
+     * coincide after snapping to the lattice.
+    */
+    std::vector<uint32_t> Subdivide(uint32_t cuboid_id, uint32_t nx, uint32_t ny, uint32_t nz);
+
+    /**
+     * Grade the mesh such that no cuboid is more than max_ratio times as long as a face neighbour along a side of their common face.
+     * Too coarse neighbours are bisected along that side, using a worklist until the mesh is balanced, which bounds the depth of the subface trees.
+     * If the mesh was balanced before some splits, passing the split and new cuboids as start is enough to balance it again.
+     * Returns the ids of all cuboids that were split or created, sorted.
+    */
+    std::vector<uint32_t> Balance(float max_ratio = 2.0f, std::span<const uint32_t> start = {});
+
+    /**
+     * Colour split requests such that no two requests of the same colour touch a common cuboid or vertex.
+     * Requests on the same cuboid get increasing colours, so they keep their order. All cuboids must already exist.
+    */
+    std::vector<uint32_t> ColourSplits(std::span<const SplitRequest> requests) const;
+
+    /**
+     * Apply a batch of splits on multiple threads, one colour class (see ColourSplits) at a time.
+     * The result is identical to applying the requests sequentially ordered by colour and then by request index,
+     * independent of the number of threads. Returns the new cuboid id of every request in request order, no_cuboid if it failed.
+    */
+    std::vector<uint32_t> SplitParallel(std::span<const SplitRequest> requests, unsigned num_threads = 0);
+
+    /**
+     * Merge two cuboids sharing a complete face into one, the inverse of SplitAlongAxis.
+     * The side faces of both must be bordered the same way, so the merged cuboid fits in the subface trees.
+     * The merged cuboid gets the lower of the two ids, the last cuboid is moved into the other id and vertices no
+     * cuboid uses anymore are removed the same way, so the mesh stays compact. Returns the merged id and these moves,
+     * so data stored per cuboid or vertex outside the mesh can be renumbered. The merged id is -1 if the cuboids can not be merged.
+    */
+    MergeResult Merge(uint32_t cuboid_a, uint32_t cuboid_b);
+
+    /**
+     * Find the cuboid containing point, -1 if the point is outside the mesh.
+     * A point on the face between two cuboids belongs to the cuboid with the higher coordinates.
+    */
+    uint32_t Locate(const Vertex& point) const;
+
+    /**
+     * Find the cuboids containing a batch of points on multiple threads, cuboid_ids must have the size of points.
+    */
+    void Locate(std::span<const Vertex> points, std::span<uint32_t> cuboid_ids, unsigned num_threads = 0) const;
+
+    /**
+     * Rebuild the point location index as a balanced tree. Splits extend the index locally,
+     * so after deep refinement of a small region a rebuild shortens the lookups.
+    */
+    void RebuildLocator();
+
+    /**
+     * Defragment the subface trees: store each tree contiguously in depth first order and give the nodes freed by splits and merges back.
+     * Worth it once a large part of the nodes is free, see getSft().numFreeNodes().
+    */
+    void CompactSubFaceTrees();
+
+    /**
+     * Find existing vertices during splits in a hash of the vertex positions instead of by searching the subface trees
+     * of the neighbours. Costs a hash entry per vertex, disabled by default. Also finds vertices the tree search misses,
+     * so the resulting mesh can have fewer duplicate vertices.
+    */
+    void EnableVertexHash(bool enable = true);
+
+    /**
+     * Record the splits and merges from now on in a refinement history, the current cuboids are its roots.
+     * Costs two history nodes per split, disabled by default. Loading a mesh starts a new history.
+    */
+    void EnableHistory(bool enable = true);
+    const RefinementHistory& getHistory() const { return history; }
+
+    /**
+     * Renumber the cuboids and vertices in the order of a space filling curve through their centres, so cuboids close
+     * in space are close in memory. All halfFaces and subface tree nodes are remapped and the point locator is rebuilt.
+     * Returns the permutation, to renumber data stored per cuboid or vertex outside the mesh.
+    */
+    MeshPermutation Reorder(CurveOrder order = CurveOrder::hilbert, unsigned num_threads = 0);
+
+    /**
+     * Check the consistency of the mesh in parallel: twin symmetry, the subface trees, coverage of every face by its
+     * neighbours, V2lV, the corner positions and duplicate vertices. Only reads the mesh.
+    */
+    ValidationReport Validate(const ValidateOptions& options = {}) const;
+
     /* Constructor of mesh object */
     Mesh();
 
-    /* Construct a uniform mesh */
-    Mesh(int Nx, int Ny, int Nz);
+    /* Construct the unit cube with split points snapped to a dyadic lattice */
+    Mesh(Lattice mesh_lattice);
+
+    /* Construct a uniform mesh, with a lattice Nx, Ny and Nz should be powers of two to get a uniform mesh */
+    Mesh(int Nx, int Ny, int Nz, Lattice mesh_lattice = {});
 
     /* Destructor of mesh object */
     ~Mesh() = default;
@@ -0,0 +1,126 @@
+#include "MeshSnapshot.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename)
+{
+#ifndef _WIN32
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("failed to open " + filename);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat " + filename);
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0) {
+        void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) throw std::runtime_error("failed to map " + filename);
+        mapped = static_cast<const uint8_t*>(map);
+    }
+    else {
+        close(fd);
+    }
+#else
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (in.fail()) throw std::runtime_error("failed to open " + filename);
+    length = static_cast<size_t>(in.tellg());
+    buffer.resize(length);
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(buffer.data()), length);
+    mapped = buffer.data();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (mapped != nullptr) munmap(const_cast<uint8_t*>(mapped), length);
+#endif
+}
+
+const SnapshotHeader& checkSnapshot(const uint8_t* data, size_t size)
+{
+    if (data == nullptr || size < sizeof(SnapshotHeader)) throw std::runtime_error("snapshot is too small");
+    const auto& header = *reinterpret_cast<const SnapshotHeader*>(data);
+    if (std::memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0) throw std::runtime_error("not a mesh snapshot");
+    if (header.byte_order != snapshot_byte_order) throw std::runtime_error("snapshot has a different byte order");
+    if (header.version != snapshot_version) throw std::runtime_error("unsupported snapshot version " + std::to_string(header.version));
+    if (header.lattice_levels > Lattice::max_levels) throw std::runtime_error("snapshot lattice has more than " + std::to_string(Lattice::max_levels) + " levels");
+    // Every element takes at least 4 bytes, larger counts can not fit in the file and would overflow the expected sizes
+    if (header.num_vertices > size || header.num_cuboids > size || header.num_nodes > size) throw std::runtime_error("snapshot is truncated or corrupt");
+    const uint64_t expected[] = {
+        header.num_vertices * sizeof(float), header.num_vertices * sizeof(float), header.num_vertices * sizeof(float),
+        header.num_cuboids * sizeof(Cuboid), header.num_cuboids * sizeof(Box), header.num_cuboids * 6 * sizeof(halfFace),
+        header.num_vertices * sizeof(localVertex), header.num_nodes * sizeof(Node)
+    };
+    for (size_t i = 0; i < static_cast<size_t>(SnapshotSection::count); i++) {
+        if (header.sizes[i] != expected[i] || header.offsets[i] % snapshot_alignment != 0 || header.offsets[i] > size || header.sizes[i] > size - header.offsets[i]) {
+            throw std::runtime_error("snapshot is truncated or corrupt");
+        }
+    }
+    return header;
+}
+
+SubFaceIterator<const SubFaceTreeView> SubFaceTreeView::find(halfFace start_node, const Vertex& v) const
+{
+    assert(start_node.isSubdivided());
+    bool is_lower = false;
+    auto child = start_node;
+    while (child.isSubdivided())
+    {
+        const Node& node = nodes[toNodeIndex(child)];
+        is_lower = lattice.below(axisCoord(v, node.getSplitAxis()), node.getSplitCoord());
+        start_node = child;
+        child = is_lower ? node.lower_child : node.top_child;
+    }
+    return SubFaceIterator<const SubFaceTreeView>(this, toNodeIndex(start_node), is_lower);
+}
+
+SubFaceIterator<const SubFaceTreeView> SubFaceTreeView::cbegin(halfFace start_node) const
+{
+    assert(start_node.isSubdivided());
+    auto node_index = toNodeIndex(start_node);
+    while (nodes[node_index].lower_child.isSubdivided()) {
+        node_index = toNodeIndex(nodes[node_index].lower_child);
+    }
+    return { this, node_index, true };
+}
+
+SubFaceIterator<const SubFaceTreeView> SubFaceTreeView::cend()
+{
+    return { nullptr, static_cast<uint32_t>(-1), false };
+}
+
+MeshView::MeshView(const std::string& filename) : file(filename)
+{
+    const auto& header = checkSnapshot(file.data(), file.size());
+    lattice.levels = static_cast<uint8_t>(header.lattice_levels);
+    xs = snapshotSection<float>(file.data(), header, SnapshotSection::x);
+    ys = snapshotSection<float>(file.data(), header, SnapshotSection::y);
+    zs = snapshotSection<float>(file.data(), header, SnapshotSection::z);
+    cuboids = snapshotSection<Cuboid>(file.data(), header, SnapshotSection::cuboids);
+    boxes = snapshotSection<Box>(file.data(), header, SnapshotSection::boxes);
+    F2f = snapshotSection<halfFace>(file.data(), header, SnapshotSection::F2f);
+    V2lV = snapshotSection<localVertex>(file.data(), header, SnapshotSection::V2lV);
+    sft.nodes = snapshotSection<Node>(file.data(), header, SnapshotSection::nodes);
+    sft.lattice = lattice;
+}
+
+std::span<const float> MeshView::coords(Axis axis) const
+{
+    switch (axis)
+    {
+    case Axis::x: return xs;
+    case Axis::y: return ys;
+    default: return zs;
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef _MESHSNAPSHOT_HPP
+#define _MESHSNAPSHOT_HPP
+#include "Types.hpp"
+#include "SubFaceTree.hpp"
+#include <span>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+* Binary mesh snapshot, a header followed by the raw mesh arrays.
+* Every section starts at a multiple of snapshot_alignment bytes, so the arrays can be used directly from a mapping of the file.
+* The arrays are stored in native byte order, the header records it so a snapshot from another machine is rejected.
+* Version history: 1 stored subface tree nodes in 20 bytes with a separate split axis, 2 stores the packed 16 byte Node
+* with the axis in the two highest bits of the split coordinate. Snapshots of another version are rejected.
+*/
+constexpr char snapshot_magic[8] = { 'S', 'P', 'L', 'M', 'E', 'S', 'H', '\0' };
+constexpr uint32_t snapshot_version = 2;
+constexpr uint32_t snapshot_byte_order = 0x01020304;
+constexpr uint64_t snapshot_alignment = 64;
+
+enum class SnapshotSection : uint32_t
+{
+    x,
+    y,
+    z,
+    cuboids,
+    boxes,
+    F2f,
+    V2lV,
+    nodes,
+    count
+};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t lattice_levels;
+    uint32_t free_list_base;
+    uint32_t free_list_head;
+    uint32_t padding;
+    uint64_t num_vertices;
+    uint64_t num_cuboids;
+    uint64_t num_nodes;
+    // Offset and size in bytes of every section
+    uint64_t offsets[static_cast<size_t>(SnapshotSection::count)];
+    uint64_t sizes[static_cast<size_t>(SnapshotSection::count)];
+};
+
+// The sections are raw copies of these types, changing their layout requires a new snapshot version
+static_assert(sizeof(Cuboid) == 32 && sizeof(Box) == 24 && sizeof(halfFace) == 4 && sizeof(localVertex) == 4 && sizeof(Node) == 16);
+
+/*
+* Read only memory mapping of a whole file. Uses mmap on POSIX systems, elsewhere the file is read into memory.
+*/
+class MappedFile
+{
+private:
+    const uint8_t* mapped = nullptr;
+    size_t length = 0;
+    std::vector<uint8_t> buffer;
+public:
+    MappedFile(const std::string& filename);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+    const uint8_t* data() const { return mapped; }
+    size_t size() const { return length; }
+};
+
+/*
+* Check the header of a snapshot and return it, throws a std::runtime_error if the file is not a valid snapshot
+*/
+const SnapshotHeader& checkSnapshot(const uint8_t* data, size_t size);
+
+template<typename T>
+std::span<const T> snapshotSection(const uint8_t* data, const SnapshotHeader& header, SnapshotSection section) {
+    const auto i = static_cast<size_t>(section);
+    return { reinterpret_cast<const T*>(data + header.offsets[i]), header.sizes[i] / sizeof(T) };
+}
+
+/*  SubFaceTreeView, read only subface trees on memory owned elsewhere
+*   Has the same search and iteration methods as the const SubFaceTree
+*/
+struct SubFaceTreeView
+{
+    std::span<const Node> nodes;
+    Lattice lattice;
+    static uint32_t toNodeIndex(halfFace from) { return from.id >> 3; }
+    SubFaceIterator<const SubFaceTreeView> find(halfFace start_node, const Vertex& v) const;
+    SubFaceIterator<const SubFaceTreeView> cbegin(halfFace start_node) const;
+    static SubFaceIterator<const SubFaceTreeView> cend();
+    // The leaves are not threaded in a snapshot, iterators climb the tree
+    static constexpr bool isThreaded() { return false; }
+    static uint32_t nextLeaf(uint32_t, bool) { return static_cast<uint32_t>(-1); }
+};
+
+/*  MeshView class, read only view on a mesh snapshot file
+*   The file is mapped once and all the arrays point into the mapping, so opening a view does not copy or parse the mesh.
+*/
+class MeshView
+{
+private:
+    MappedFile file;
+    Lattice lattice;
+    std::span<const float> xs, ys, zs;
+    std::span<const Cuboid> cuboids;
+    std::span<const Box> boxes;
+    std::span<const halfFace> F2f;
+    std::span<const localVertex> V2lV;
+    SubFaceTreeView sft;
+public:
+    MeshView(const std::string& filename);
+    size_t numVertices() const { return xs.size(); }
+    Vertex vertex(uint32_t v) const { return { xs[v], ys[v], zs[v] }; }
+    // The coordinates of all vertices along an axis
+    std::span<const float> coords(Axis axis) const;
+    std::span<const Cuboid> getCuboids() const { return cuboids; }
+    std::span<const Box> getBoxes() const { return boxes; }
+    std::span<const halfFace> getF2f() const { return F2f; }
+    std::span<const localVertex> getV2lV() const { return V2lV; }
+    const SubFaceTreeView& getSft() const { return sft; }
+    const Lattice& getLattice() const { return lattice; }
+    halfFace Twin(const halfFace hf) const { return F2f[static_cast<size_t>(hf.getCuboid()) * 6 + hf.getLocalId()]; }
+};
+#endif
@@ -0,0 +1,77 @@
+#ifndef _MESHVALIDATION_HPP
+#define _MESHVALIDATION_HPP
+#include <array>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* Kinds of inconsistencies found by Mesh::Validate
+*/
+enum class MeshViolation : uint8_t
+{
+    // A halfFace and its twin do not point back to each other, or the twin is not the opposite face
+    twin,
+    // A subface tree node has a wrong parent or a split outside its part of the face
+    subface_tree,
+    // A face is not covered by its twin or the leaves of its subface tree, or a border face is not on the border of the domain
+    coverage,
+    // V2lV of a vertex does not point to a corner of a cuboid that is that vertex
+    vertex_map,
+    // A corner vertex of a cuboid is not at the corner of its bounding box
+    corner_position,
+    // Two vertices have the same position
+    duplicate_vertex,
+    // A vertex lies outside of the unit cube
+    outside_domain,
+    count
+};
+
+/*
+* A single violation. id is the halfFace id for face violations, the node index for subface tree violations and the vertex
+* or cuboid id otherwise. other is the twin, leaf or second vertex involved, -1 if there is none.
+*/
+struct Violation
+{
+    MeshViolation kind;
+    uint32_t id;
+    uint32_t other;
+};
+
+struct ValidateOptions
+{
+    bool check_faces = true;
+    bool check_vertices = true;
+    // Sorts all vertex positions, the most expensive check
+    bool check_duplicates = true;
+    // At most this many violations are stored in the report, all of them are counted
+    size_t max_reported = 64;
+    unsigned num_threads = 0;
+};
+
+struct ValidationReport
+{
+    std::array<size_t, static_cast<size_t>(MeshViolation::count)> counts{};
+    // The first violations ordered by kind and id
+    std::vector<Violation> violations;
+    size_t count(MeshViolation kind) const { return counts[static_cast<size_t>(kind)]; }
+    bool valid() const {
+        for (const auto n : counts) if (n != 0) return false;
+        return true;
+    }
+};
+
+static inline const char* violationName(MeshViolation kind) {
+    switch (kind)
+    {
+    case MeshViolation::twin: return "twin";
+    case MeshViolation::subface_tree: return "subface tree";
+    case MeshViolation::coverage: return "coverage";
+    case MeshViolation::vertex_map: return "vertex map";
+    case MeshViolation::corner_position: return "corner position";
+    case MeshViolation::duplicate_vertex: return "duplicate vertex";
+    case MeshViolation::outside_domain: return "outside domain";
+    default: return "unknown";
+    }
+}
+#endif
@@ -0,0 +1,74 @@
+#ifndef _PARALLEL_HPP // Header guard
+#define _PARALLEL_HPP
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <stdint.h>
+
+/*
+* Number of worker threads to use, 0 means one per hardware thread
+*/
+static inline unsigned numThreads(unsigned requested = 0) {
+	if (requested != 0) return requested;
+	const unsigned hardware = std::thread::hardware_concurrency();
+	return hardware == 0 ? 1 : hardware;
+}
+
+/*
+* Call fn(thread, begin, end) for contiguous chunks of [0, count), one chunk per thread.
+* Small ranges are handled on the calling thread, since starting threads costs more than the work.
+*/
+template<typename Fn>
+void parallelChunks(size_t count, Fn&& fn, unsigned num_threads = 0, size_t grain = 1024) {
+	const size_t threads = std::min<size_t>(numThreads(num_threads), (count + grain - 1) / std::max<size_t>(grain, 1));
+	if (threads <= 1) {
+		fn(0u, size_t{ 0 }, count);
+		return;
+	}
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	const size_t chunk = (count + threads - 1) / threads;
+	for (unsigned t = 1; t < threads; ++t) {
+		const size_t begin = std::min(count, t * chunk);
+		const size_t end = std::min(count, begin + chunk);
+		workers.emplace_back([&fn, t, begin, end]() { fn(t, begin, end); });
+	}
+	fn(0u, size_t{ 0 }, std::min(count, chunk));
+	for (auto& worker : workers) worker.join();
+}
+
+/*
+* Call fn(i) for every i in [0, count) in parallel
+*/
+template<typename Fn>
+void parallelFor(size_t count, Fn&& fn, unsigned num_threads = 0, size_t grain = 1024) {
+	parallelChunks(count, [&fn](unsigned, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) fn(i);
+	}, num_threads, grain);
+}
+
+/*
+* Sort [begin, end) in parallel, every thread sorts a chunk and the chunks are then merged pairwise
+*/
+template<typename It, typename Compare>
+void parallelSort(It begin, It end, Compare comp, unsigned num_threads = 0, size_t grain = 1 << 14) {
+	const size_t count = static_cast<size_t>(std::distance(begin, end));
+	const auto at = [begin](size_t i) { return begin + static_cast<std::iter_difference_t<It>>(i); };
+	std::vector<std::pair<size_t, size_t>> ranges(numThreads(num_threads), { count, count });
+	parallelChunks(count, [&](unsigned t, size_t first, size_t last) {
+		std::sort(at(first), at(last), comp);
+		ranges[t] = { first, last };
+	}, num_threads, grain);
+	ranges.erase(std::remove_if(ranges.begin(), ranges.end(), [](const auto& range) { return range.first == range.second; }), ranges.end());
+	while (ranges.size() > 1) {
+		parallelFor(ranges.size() / 2, [&](size_t i) {
+			std::inplace_merge(at(ranges[2 * i].first), at(ranges[2 * i].second), at(ranges[2 * i + 1].second), comp);
+		}, num_threads, 1);
+		std::vector<std::pair<size_t, size_t>> merged;
+		for (size_t i = 0; i + 1 < ranges.size(); i += 2) merged.push_back({ ranges[i].first, ranges[i + 1].second });
+		if (ranges.size() % 2 == 1) merged.push_back(ranges.back());
+		ranges = std::move(merged);
+	}
+}
+#endif
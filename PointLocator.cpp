@@ -0,0 +1,166 @@
+#include "PointLocator.hpp"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+/*
+* A single leaf for the unit cube
+*/
+PointLocator::PointLocator()
+{
+    nodes.push_back({ 0.0f, Axis::x, NodeType::leaf, 0, 0 });
+    leaf_of.push_back(0);
+}
+
+void PointLocator::build(std::span<const Box> boxes)
+{
+    assert(!boxes.empty());
+    nodes.clear();
+    buckets.clear();
+    free_nodes.clear();
+    leaf_of.assign(boxes.size(), 0);
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    domain = { { inf, inf, inf }, { -inf, -inf, -inf } };
+    for (const auto& box : boxes) {
+        domain.min = { std::min(domain.min.x, box.min.x), std::min(domain.min.y, box.min.y), std::min(domain.min.z, box.min.z) };
+        domain.max = { std::max(domain.max.x, box.max.x), std::max(domain.max.y, box.max.y), std::max(domain.max.z, box.max.z) };
+    }
+    std::vector<uint32_t> ids(boxes.size());
+    std::iota(ids.begin(), ids.end(), 0);
+    buildRange(ids, boxes);
+}
+
+size_t PointLocator::findCut(std::span<uint32_t> ids, std::span<const Box> boxes, Axis& axis, float& coordinate)
+{
+    size_t best_count = 0;
+    for (const Axis candidate : { Axis::x, Axis::y, Axis::z }) {
+        std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) { return axisCoord(boxes[a].min, candidate) < axisCoord(boxes[b].min, candidate); });
+        // A cut before box i is possible if all boxes before it end before it starts
+        float max_end = axisCoord(boxes[ids[0]].max, candidate);
+        for (size_t i = 1; i < ids.size(); i++) {
+            const float start = axisCoord(boxes[ids[i]].min, candidate);
+            if (max_end <= start && std::min(i, ids.size() - i) > std::min(best_count, ids.size() - best_count)) {
+                best_count = i;
+                axis = candidate;
+                coordinate = start;
+            }
+            max_end = std::max(max_end, axisCoord(boxes[ids[i]].max, candidate));
+        }
+    }
+    if (best_count != 0) {
+        std::partition(ids.begin(), ids.end(), [&](uint32_t id) { return axisCoord(boxes[id].min, axis) < coordinate; });
+    }
+    return best_count;
+}
+
+/*
+* Build the subtree for the cuboids in ids, creates a bucket if there is no cut. Returns the index of the created node.
+*/
+uint32_t PointLocator::buildRange(std::span<uint32_t> ids, std::span<const Box> boxes)
+{
+    const uint32_t node_index = static_cast<uint32_t>(nodes.size());
+    if (ids.size() == 1) {
+        nodes.push_back({ 0.0f, Axis::x, NodeType::leaf, ids[0], 0 });
+        leaf_of[ids[0]] = node_index;
+        return node_index;
+    }
+    nodes.push_back({});
+    Axis axis = Axis::x;
+    float coordinate = 0.0f;
+    const size_t num_lower = findCut(ids, boxes, axis, coordinate);
+    if (num_lower == 0) {
+        nodes[node_index] = { 0.0f, Axis::x, NodeType::bucket, static_cast<uint32_t>(buckets.size()), 0 };
+        buckets.emplace_back(ids.begin(), ids.end());
+        for (const auto id : ids) leaf_of[id] = node_index;
+        return node_index;
+    }
+    const uint32_t lower = buildRange(ids.subspan(0, num_lower), boxes);
+    const uint32_t top = buildRange(ids.subspan(num_lower), boxes);
+    nodes[node_index] = { coordinate, axis, NodeType::inner, lower, top };
+    return node_index;
+}
+
+void PointLocator::split(uint32_t cuboid_id, Axis axis, float coordinate, uint32_t new_cuboid_id)
+{
+    assert(cuboid_id < leaf_of.size());
+    if (leaf_of.size() <= new_cuboid_id) leaf_of.resize(new_cuboid_id + 1);
+    const uint32_t leaf_index = leaf_of[cuboid_id];
+    if (nodes[leaf_index].type == NodeType::bucket) {
+        // Both halves stay in the bucket
+        buckets[nodes[leaf_index].lower].push_back(new_cuboid_id);
+        leaf_of[new_cuboid_id] = leaf_index;
+        return;
+    }
+    const uint32_t lower = allocNode();
+    const uint32_t top = allocNode();
+    nodes[lower] = { 0.0f, Axis::x, NodeType::leaf, cuboid_id, 0 };
+    nodes[top] = { 0.0f, Axis::x, NodeType::leaf, new_cuboid_id, 0 };
+    nodes[leaf_index] = { coordinate, axis, NodeType::inner, lower, top };
+    leaf_of[cuboid_id] = lower;
+    leaf_of[new_cuboid_id] = top;
+}
+
+uint32_t PointLocator::allocNode()
+{
+    if (free_nodes.empty()) {
+        nodes.push_back({});
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+    const uint32_t node_index = free_nodes.back();
+    free_nodes.pop_back();
+    return node_index;
+}
+
+bool PointLocator::merge(uint32_t lower_cuboid, uint32_t top_cuboid, uint32_t keep, const Vertex& point)
+{
+    const uint32_t lower_leaf = leaf_of[lower_cuboid];
+    const uint32_t top_leaf = leaf_of[top_cuboid];
+    if (lower_leaf == top_leaf && nodes[lower_leaf].type == NodeType::bucket) {
+        // Drop the other cuboid from the bucket
+        auto& bucket = buckets[nodes[lower_leaf].lower];
+        const uint32_t other = keep == lower_cuboid ? top_cuboid : lower_cuboid;
+        bucket.erase(std::find(bucket.begin(), bucket.end(), other));
+        return true;
+    }
+    if (nodes[lower_leaf].type != NodeType::leaf || nodes[top_leaf].type != NodeType::leaf) return false;
+    // Search the parent of the lower leaf
+    uint32_t parent = static_cast<uint32_t>(-1);
+    uint32_t node_index = 0;
+    while (nodes[node_index].type == NodeType::inner) {
+        parent = node_index;
+        node_index = axisCoord(point, nodes[node_index].axis) < nodes[node_index].split ? nodes[node_index].lower : nodes[node_index].top;
+    }
+    if (node_index != lower_leaf || parent == static_cast<uint32_t>(-1) || nodes[parent].top != top_leaf) return false;
+    nodes[parent] = { 0.0f, Axis::x, NodeType::leaf, keep, 0 };
+    leaf_of[keep] = parent;
+    free_nodes.push_back(lower_leaf);
+    free_nodes.push_back(top_leaf);
+    return true;
+}
+
+void PointLocator::rename(uint32_t from, uint32_t to)
+{
+    const uint32_t leaf_index = leaf_of[from];
+    leaf_of[to] = leaf_index;
+    if (nodes[leaf_index].type == NodeType::leaf) {
+        nodes[leaf_index].lower = to;
+        return;
+    }
+    auto& bucket = buckets[nodes[leaf_index].lower];
+    *std::find(bucket.begin(), bucket.end(), from) = to;
+}
+
+uint32_t PointLocator::depth() const
+{
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { {0, 1} };
+    uint32_t max_depth = 0;
+    while (!stack.empty()) {
+        const auto [node_index, node_depth] = stack.back();
+        stack.pop_back();
+        max_depth = std::max(max_depth, node_depth);
+        if (nodes[node_index].type != NodeType::inner) continue;
+        stack.push_back({ nodes[node_index].lower, node_depth + 1 });
+        stack.push_back({ nodes[node_index].top, node_depth + 1 });
+    }
+    return max_depth;
+}
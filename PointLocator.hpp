@@ -0,0 +1,91 @@
+#ifndef _POINTLOCATOR_HPP
+#define _POINTLOCATOR_HPP
+#include "Types.hpp"
+#include <cassert>
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+/*  PointLocator class, a KD-tree over the cuboids of a mesh to find the cuboid containing a point
+*   Every inner node is an axis aligned cut of which all cuboids lie completely on one side, the leaves are cuboids.
+*   Splitting a cuboid turns its leaf into an inner node, so the tree follows the refinement without rebuilding.
+*   If no such cut exists for a group of cuboids, they are stored in a bucket leaf which is searched linearly.
+*/
+class PointLocator
+{
+public:
+    enum class NodeType : uint8_t
+    {
+        inner,
+        leaf,
+        bucket
+    };
+    struct LocatorNode
+    {
+        float split;
+        Axis axis;
+        NodeType type;
+        // Inner node: the child nodes, points with coordinate < split go to lower
+        // Leaf: the cuboid in lower, bucket: the bucket index in lower
+        uint32_t lower;
+        uint32_t top;
+    };
+private:
+    std::vector<LocatorNode> nodes;
+    // Leaf or bucket node of every cuboid
+    std::vector<uint32_t> leaf_of;
+    std::vector<std::vector<uint32_t>> buckets;
+    // Nodes released by merges, reused by splits
+    std::vector<uint32_t> free_nodes;
+    uint32_t allocNode();
+    Box domain{ { 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } };
+    uint32_t buildRange(std::span<uint32_t> ids, std::span<const Box> boxes);
+public:
+    PointLocator();
+    // Build a balanced tree over cuboids given by their bounding boxes
+    void build(std::span<const Box> boxes);
+    // Cuboid cuboid_id has been split at coordinate along axis, the top part got new_cuboid_id
+    void split(uint32_t cuboid_id, Axis axis, float coordinate, uint32_t new_cuboid_id);
+    /*
+    * Cuboids lower_cuboid and top_cuboid have been merged into keep, point lies inside lower_cuboid.
+    * Collapses the inner node above two sibling leaves or drops a cuboid from a shared bucket.
+    * Returns false if the two are neither, the tree is then unchanged and has to be rebuilt.
+    */
+    bool merge(uint32_t lower_cuboid, uint32_t top_cuboid, uint32_t keep, const Vertex& point);
+    // Cuboid from got the id to
+    void rename(uint32_t from, uint32_t to);
+    // Forget all cuboids with an id of at least num_cuboids
+    void truncate(size_t num_cuboids) { leaf_of.resize(num_cuboids); }
+    /*
+    * Find the axis aligned cut closest to the middle of the boxes in ids that no box crosses.
+    * Reorders ids such that the boxes below the cut come first and returns their number, 0 if there is no such cut.
+    */
+    static size_t findCut(std::span<uint32_t> ids, std::span<const Box> boxes, Axis& axis, float& coordinate);
+    // Maximal depth of the tree, for testing the balance
+    uint32_t depth() const;
+    const std::vector<LocatorNode>& getNodes() const { return nodes; }
+    /*
+    * Find the cuboid containing point p, -1 if p is outside the domain
+    * Points on a cut belong to the cuboid above it. contains(cuboid, p) is only called for cuboids in bucket leaves
+    */
+    template<typename Contains>
+    uint32_t locate(const Vertex& p, Contains&& contains) const;
+};
+
+template<typename Contains>
+uint32_t PointLocator::locate(const Vertex& p, Contains&& contains) const
+{
+    if (!domain.contains(p)) return static_cast<uint32_t>(-1);
+    uint32_t node_index = 0;
+    while (nodes[node_index].type == NodeType::inner) {
+        const LocatorNode& node = nodes[node_index];
+        node_index = axisCoord(p, node.axis) < node.split ? node.lower : node.top;
+    }
+    const LocatorNode& leaf = nodes[node_index];
+    if (leaf.type == NodeType::leaf) return leaf.lower;
+    for (const auto cuboid : buckets[leaf.lower]) {
+        if (contains(cuboid, p)) return cuboid;
+    }
+    return static_cast<uint32_t>(-1);
+}
+#endif
@@ -41,52 +41,56 @@ int QuantitiesOfInterest::interiorFaces() const
     return F + hfs.size();
 }
 
+int QuantitiesOfInterest::interiorEdges() const
+{
+    const auto edges = getAllEdges();
+    return static_cast<int>(std::count_if(edges.begin(), edges.end(), [&](const Edge& edge) { return !isBorderEdge(edge); }));
+}
+
 /**
  * Returns the amount of elements which are connected to/ linked with the given vertex.
  */
 VertexConnectivity QuantitiesOfInterest::vertexConnectivity(uint32_t vertex) const {
     std::array<uint32_t, 8> elements{-1,-1,-1,-1,-1,-1,-1,-1}; // At most 8 elements can be connected to a vertex
-    const Vertex& coord = mesh.getVertices()[vertex];
+    const Vertex coord = mesh.getVertices()[vertex];
     localVertex lv = mesh.getV2lV()[vertex];
     uint32_t x = 0;
-    auto moveToNext = [&](uint32_t& cuboid, uint8_t direction) {
-        // first check if the vertex lies inside the face
-        const Vertex& face = mesh.getVertices()[mesh.getCuboids()[cuboid].vertices[Hf2Ve[direction][0]]];
-        bool inFace = false;
-        switch (Hf2Ax[direction])
-        {
-
-        case Axis::x: inFace = floatSame(coord.x, face.x); break;
-        case Axis::y: inFace = floatSame(coord.y, face.y); break;
-        case Axis::z: inFace = floatSame(coord.z, face.z); break;
+    // The cuboids across the given faces which contain the vertex, no_cuboid if there is none. These do not depend on the
+    // elements found so far, so the cuboids of one step of the walk are located in one batched find
+    auto neighbours = [&](const std::array<uint32_t, 3>& cuboids, const std::array<uint8_t, 3>& directions) {
+        std::array<halfFace, 3> twins{ halfFace(border_id), halfFace(border_id), halfFace(border_id) };
+        for (size_t i = 0; i < 3; i++) {
+            if (cuboids[i] == Mesh::no_cuboid) continue;
+            // first check if the vertex lies inside the face
+            const uint32_t face_vertex = mesh.getCuboids()[cuboids[i]].vertices[Hf2Ve[directions[i]][0]];
+            const bool inFace = mesh.getLattice().same(mesh.getVertices().coord(vertex, Hf2Ax[directions[i]]), mesh.getVertices().coord(face_vertex, Hf2Ax[directions[i]]));
+            if (inFace) twins[i] = mesh.Twin(halfFace(cuboids[i], directions[i]));
         }
-        if (!inFace) return false;
-        auto twin = mesh.Twin(halfFace(cuboid, direction));
-        uint32_t new_cuboid;
-        if (twin.isBorder()) return false;
-        if (twin.isSubdivided()) { new_cuboid = (*mesh.getSft().find(twin, coord)).getCuboid(); }
-        else new_cuboid = twin.getCuboid();
-        if (contains(elements, new_cuboid)) return false;
-        elements[x++] = new_cuboid;
-        cuboid = new_cuboid;
+        const std::array<Vertex, 3> points{ coord, coord, coord };
+        std::array<halfFace, 3> found = twins;
+        mesh.getSft().find(twins, points, found);
+        std::array<uint32_t, 3> result;
+        for (size_t i = 0; i < 3; i++) result[i] = found[i].isBorder() ? Mesh::no_cuboid : found[i].getCuboid();
+        return result;
+    };
+    auto add = [&](uint32_t cuboid) {
+        if (cuboid == Mesh::no_cuboid || contains(elements, cuboid)) return false;
+        elements[x++] = cuboid;
         return true;
     };
     elements[x++] = lv.getCuboid();
-    auto directions = Lv2Hf[lv.getLocalId()];
-    uint32_t currentCuboid = lv.getCuboid();
+    const auto directions = Lv2Hf[lv.getLocalId()];
+    const uint32_t start = lv.getCuboid();
+    const auto first = neighbours({ start, start, start }, directions);
+    const auto second = neighbours({ first[0], first[0], first[1] }, { directions[1], directions[2], directions[2] });
+    const auto third = neighbours({ second[0], Mesh::no_cuboid, Mesh::no_cuboid }, { directions[2], directions[2], directions[2] });
     // Check all 7 neccasarry cuboids with early stopping
-    if (moveToNext(currentCuboid, directions[0])) {
-        uint32_t temp = currentCuboid;
-        if (moveToNext(currentCuboid, directions[1])) moveToNext(currentCuboid, directions[2]);
-        currentCuboid = temp;
-        moveToNext(currentCuboid, directions[2]);
-    }
-    currentCuboid = lv.getCuboid();
-    if (moveToNext(currentCuboid, directions[1])) {
-        moveToNext(currentCuboid, directions[2]);
+    if (add(first[0])) {
+        if (add(second[0])) add(third[0]);
+        add(second[1]);
     }
-    currentCuboid = lv.getCuboid();
-    moveToNext(currentCuboid, directions[2]);
+    if (add(first[1])) add(second[2]);
+    add(first[2]);
     return {elements, x};
 }
 
@@ -105,21 +109,14 @@ bool QuantitiesOfInterest::isEVertex(uint32_t vertex) const
 {
     std::array<uint32_t, 8> elements{ -1,-1,-1,-1,-1,-1,-1,-1 }; // At most 8 elements can be connected to a vertex
     std::array<uint32_t, 2> non_unique{ -1,-1 };
-    const Vertex& coord = mesh.getVertices()[vertex];
+    const Vertex coord = mesh.getVertices()[vertex];
     localVertex lv = mesh.getV2lV()[vertex];
     uint32_t x = 0;
     uint32_t n_u = 0;
     auto moveToNext = [&](uint32_t& cuboid, uint8_t direction) {
         // first check if the vertex lies inside the face
-        const Vertex& face = mesh.getVertices()[mesh.getCuboids()[cuboid].vertices[Hf2Ve[direction][0]]];
-        bool inFace = false;
-        switch (Hf2Ax[direction])
-        {
-
-        case Axis::x: inFace = floatSame(coord.x, face.x); break;
-        case Axis::y: inFace = floatSame(coord.y, face.y); break;
-        case Axis::z: inFace = floatSame(coord.z, face.z); break;
-        }
+        const uint32_t face_vertex = mesh.getCuboids()[cuboid].vertices[Hf2Ve[direction][0]];
+        const bool inFace = mesh.getLattice().same(mesh.getVertices().coord(vertex, Hf2Ax[direction]), mesh.getVertices().coord(face_vertex, Hf2Ax[direction]));
         if (!inFace) {
             if (n_u < 2) non_unique[n_u++] = cuboid;
             return false;
@@ -160,7 +157,7 @@ bool QuantitiesOfInterest::isEVertex(uint32_t vertex) const
     moveToNext(currentCuboid, directions[2]);
     if (x == 6) {
         // Check if the duplicates touch each other
-        return !mesh.Adjacent(non_unique[0], non_unique[1]);
+        return !mesh.getDualGraph().adjacent(non_unique[0], non_unique[1]);
     }
     return false;
 }
@@ -215,60 +212,61 @@ static constexpr std::pair<uint8_t, uint8_t> axesToCheck(uint8_t local_face_id)
 const std::vector<halfFace> QuantitiesOfInterest::getMaximalSegmentOf(halfFace currFace) {
     assert(!currFace.isBorder());
     const auto dirs_to_check = axesToCheck(currFace.getLocalId());
-    const auto perfect_match = [&](const halfFace hf, halfFace& twin) {
+    // The two vertices of hf which the next face of the segment should also have
+    const auto segment_vertices = [&](const halfFace hf) {
+        const auto local_vertices = Hf2Clv[hf.getLocalId()][currFace.getLocalId()];
+        const auto& verts = mesh.getCuboids()[hf.getCuboid()];
+        return std::array<uint32_t, 2>{ verts.vertices[local_vertices[0]], verts.vertices[local_vertices[1]] };
+    };
+    // twin is the face across hf, already found in the subface tree if that face was subdivided
+    const auto perfect_match = [&](const halfFace hf, const halfFace twin, const bool subdivided) {
         if (twin.isBorder()) return false;
-        if (twin.isSubdivided()) {
-            // Check if we maybe still have a perfect match
-            // Check for a vertex which exists in both halfFaces
-            const auto local_vertices = Hf2Clv[hf.getLocalId()][currFace.getLocalId()];
-            const auto& verts = mesh.getCuboids()[hf.getCuboid()];
-            const std::array<uint32_t, 2> ver_ids = { verts.vertices[local_vertices[0]],verts.vertices[local_vertices[1]] };
-            const auto twin_hf = *mesh.getSft().find(twin, mesh.getVertices()[ver_ids[0]]);
-            // Check if both the required vertices exist in the found half Face
-            const auto& twin_verts = mesh.getCuboids()[twin_hf.getCuboid()];
-            twin = twin_hf;
-            return contains(twin_verts.vertices, ver_ids[0]) && contains(twin_verts.vertices, ver_ids[1]);
-        }
-        const auto twin_of_twin = mesh.Twin(twin);
-        if (twin_of_twin.isSubdivided()) {
-            // Check if we maybe still have a perfect match
+        if (!subdivided && !mesh.Twin(twin).isSubdivided()) return true;
+        // Check if we maybe still have a perfect match
+        // Check if both the required vertices exist in the twin
+        const auto ver_ids = segment_vertices(hf);
+        const auto& twin_verts = mesh.getCuboids()[twin.getCuboid()];
+        return contains(twin_verts.vertices, ver_ids[0]) && contains(twin_verts.vertices, ver_ids[1]);
+    };
+    // Walk the negative and positive first and second direction in lockstep, the twins on subdivided faces of
+    // one step are located in one batched find
+    const std::array<uint8_t, 4> directions{ mesh.opposite_face(dirs_to_check.first), dirs_to_check.first,
+                                             mesh.opposite_face(dirs_to_check.second), dirs_to_check.second };
+    std::array<std::vector<halfFace>, 4> segments;
+    std::array<halfFace, 4> current{ currFace, currFace, currFace, currFace };
+    std::array<halfFace, 4> faces = current;
+    std::array<halfFace, 4> twins = current;
+    std::array<halfFace, 4> found = current;
+    std::array<Vertex, 4> points{};
+    std::array<bool, 4> walking{ true, true, true, true };
+    while (std::find(walking.begin(), walking.end(), true) != walking.end()) {
+        for (size_t i = 0; i < 4; i++) {
+            twins[i] = halfFace(border_id);
+            if (!walking[i]) continue;
+            faces[i] = halfFace(current[i].getCuboid(), directions[i]);
+            twins[i] = mesh.Twin(faces[i]);
             // Check for a vertex which exists in both halfFaces
-            const auto local_vertices = Hf2Clv[hf.getLocalId()][currFace.getLocalId()];
-            const auto& verts = mesh.getCuboids()[hf.getCuboid()];
-            const std::array<uint32_t, 2> ver_ids = { verts.vertices[local_vertices[0]],verts.vertices[local_vertices[1]] };
-            // Check if both the required vertices exist in the twin
-            const auto& twin_verts = mesh.getCuboids()[twin.getCuboid()];
-            return contains(twin_verts.vertices, ver_ids[0]) && contains(twin_verts.vertices, ver_ids[1]);
+            if (twins[i].isSubdivided()) points[i] = mesh.getVertices()[segment_vertices(faces[i])[0]];
         }
-        return true;
-    };
-    const auto gotoAdjacent = [&](const halfFace hf) {
-        auto next_elem = mesh.Twin(hf);
-        if(!perfect_match(hf, next_elem)) return halfFace(border_id);
-        return halfFace(next_elem.getCuboid(), currFace.getLocalId());
-    };
-    const auto goDirection = [&](const halfFace hf, const uint8_t direction, std::vector<halfFace>& segments) {
-        auto next = gotoAdjacent(halfFace(hf.getCuboid(), direction));
-        while (!next.isBorder()) {
-            segments.push_back(next);
-            next = gotoAdjacent(halfFace(next.getCuboid(), direction));
+        mesh.getSft().find(twins, points, found);
+        for (size_t i = 0; i < 4; i++) {
+            if (!walking[i]) continue;
+            if (!perfect_match(faces[i], found[i], twins[i].isSubdivided())) {
+                walking[i] = false;
+                continue;
+            }
+            current[i] = halfFace(found[i].getCuboid(), currFace.getLocalId());
+            segments[i].push_back(current[i]);
         }
-    };
-    std::vector<halfFace> first_direction;
-    // Check the first direction in the negative direction
-    goDirection(currFace, mesh.opposite_face(dirs_to_check.first), first_direction);
-    std::reverse(first_direction.begin(), first_direction.end());
+    }
+    // Negative direction reversed, the start face, then the positive direction
+    std::vector<halfFace> first_direction(segments[0].rbegin(), segments[0].rend());
     first_direction.push_back(currFace);
-    // Check the first direction in the positive direction;
-    goDirection(currFace, dirs_to_check.first, first_direction);
+    first_direction.insert(first_direction.end(), segments[1].begin(), segments[1].end());
 
-    std::vector<halfFace> second_direction;
-    // Check the second direction in the negative direction
-    goDirection(currFace, mesh.opposite_face(dirs_to_check.second), second_direction);
-    std::reverse(second_direction.begin(), second_direction.end());
+    std::vector<halfFace> second_direction(segments[2].rbegin(), segments[2].rend());
     second_direction.push_back(currFace);
-    // Check the second direction in the positive direction;
-    goDirection(currFace, dirs_to_check.second, second_direction);
+    second_direction.insert(second_direction.end(), segments[3].begin(), segments[3].end());
 
     return (first_direction.size() >= second_direction.size()) ? first_direction : second_direction;
 }
@@ -280,82 +278,72 @@ const std::vector<halfFace> QuantitiesOfInterest::getMaximalSegmentOf(halfFace c
  * Row indices (outer vector ids) should represent vertex ids and column indices (inner vector ids) 
  * should represent cuboid ids to which the (row) vertex is connected to. 
  * If there is no connection between the cuboid and vertex, then a 0 is inserted at that position.
+ * The entries are taken from the vertex star of the mesh, with include_hanging a hanging vertex is also connected
+ * to the cuboids on whose faces or edges it lies.
  */
-const Eigen::SparseMatrix<bool>& QuantitiesOfInterest::ElementVertexIncidenceMatrix() {
-    std::vector<Triplet> tripletList;
-    tripletList.reserve(mesh.getV2lV().size() * 3);
-    for (int j = 0; j < mesh.getV2lV().size(); j++) {
-        for (int i = 0; i < mesh.getCuboids().size(); i++) {
-            if (contains(mesh.getCuboids()[i].vertices, j)) {
-                tripletList.push_back({ j,i,true });
+const Eigen::SparseMatrix<bool>& QuantitiesOfInterest::ElementVertexIncidenceMatrix(bool include_hanging) {
+    const VertexStar& star = mesh.getVertexStar();
+    std::vector<Eigen::Triplet<bool>> tripletList;
+    tripletList.reserve(star.getCuboids().size());
+    for (uint32_t v = 0; v < star.size(); v++) {
+        for (const auto cuboid : star.cuboids(v)) {
+            if (include_hanging || contains(mesh.getCuboids()[cuboid].vertices, v)) {
+                tripletList.push_back({ static_cast<int>(v), static_cast<int>(cuboid), true });
             }
         }
     }
+    incidence.resize(static_cast<Eigen::Index>(mesh.getVertices().size()), static_cast<Eigen::Index>(mesh.getCuboids().size()));
     incidence.setFromTriplets(tripletList.cbegin(), tripletList.cend());
     return incidence;
 }
 
 /**
 * Signed incidence matrix to show connectivity how vertices are paired with each other. 
+* Dense, use VertexEdgeIncidenceOperator for large meshes.
 */
 const MatrixXf QuantitiesOfInterest::VertexEdgeIncidenceMatrix()
 {
-    std::vector<Edge> edges = getAllEdges();
-    MatrixXf matrix(edges.size(), mesh.getVertices().size());
-
-    //initial matrix
-    for (int i = 0; i < edges.size(); i++) {
-        for (int j = 0; j < mesh.getVertices().size(); j++) {
-            matrix(i, j) = 0;
-        }
-    }
-
-    Vertex origin{ 0,0,0 };
-    for (int i = 0; i < edges.size(); i++) {
-        if (mesh.getVertices()[edges[i].v1] - mesh.getVertices()[edges[i].v2] >= origin) {
-            matrix(i, edges[i].v2) = -1;
-            matrix(i, edges[i].v1) = 1;
-        }
-        else if (mesh.getVertices()[edges[i].v2] - mesh.getVertices()[edges[i].v1] >= origin) {
-            matrix(i, edges[i].v2) = 1;
-            matrix(i, edges[i].v1) = -1;
-        }
+    const IncidenceOperator incidence_operator = VertexEdgeIncidenceOperator();
+    MatrixXf matrix = MatrixXf::Zero(static_cast<Eigen::Index>(incidence_operator.rows()), static_cast<Eigen::Index>(incidence_operator.cols()));
+    for (uint32_t e = 0; e < incidence_operator.rows(); e++) {
+        matrix(e, incidence_operator.tail(e)) = -1;
+        matrix(e, incidence_operator.head(e)) = 1;
     }
     return matrix;
 }
 
+/**
+* Sparse signed incidence operator, built from the edge table.
+*/
+IncidenceOperator QuantitiesOfInterest::VertexEdgeIncidenceOperator()
+{
+    return IncidenceOperator(getEdgeTable(), mesh.getVertices());
+}
+
 /**
 * Retrieving every edge of the mesh.
 */
 const std::vector<Edge> QuantitiesOfInterest::getAllEdges() const {
-    std::vector<Edge> res;
-    for (auto i = 0; i < mesh.getCuboids().size(); i++) {
-        for (Edge curr : getEdges(i)) {
-            if (!contains(res, curr)) {
-                res.push_back(curr);
-            }
-        }
+    return EdgeTable(mesh).getEdges();
+}
+
+const EdgeTable& QuantitiesOfInterest::getEdgeTable() {
+    if (!edge_table_built) {
+        edge_table = EdgeTable(mesh);
+        edge_table_built = true;
     }
-    return res;
+    return edge_table;
 }
+
 /**
 * Retrieving the 12 edges of a given cuboid.
 */
-const std::vector<Edge> QuantitiesOfInterest::getEdges(uint32_t cuboid_id) const {
-    std::vector<Edge> res;
+std::array<Edge, 12> QuantitiesOfInterest::getEdges(uint32_t cuboid_id) const {
+    std::array<Edge, 12> res;
     const Cuboid& cuboid = mesh.getCuboids()[cuboid_id];
-    res.push_back(Edge{ cuboid.v1, cuboid.v2, cuboid_id });
-    res.push_back(Edge{ cuboid.v1, cuboid.v4, cuboid_id });
-    res.push_back(Edge{ cuboid.v1, cuboid.v5, cuboid_id });
-    res.push_back(Edge{ cuboid.v2, cuboid.v3, cuboid_id });
-    res.push_back(Edge{ cuboid.v2, cuboid.v6, cuboid_id });
-    res.push_back(Edge{ cuboid.v3, cuboid.v4, cuboid_id });
-    res.push_back(Edge{ cuboid.v3, cuboid.v7, cuboid_id });
-    res.push_back(Edge{ cuboid.v4, cuboid.v8, cuboid_id });
-    res.push_back(Edge{ cuboid.v5, cuboid.v6, cuboid_id });
-    res.push_back(Edge{ cuboid.v5, cuboid.v8, cuboid_id });
-    res.push_back(Edge{ cuboid.v6, cuboid.v7, cuboid_id });
-    res.push_back(Edge{ cuboid.v7, cuboid.v8, cuboid_id });
+    for (size_t i = 0; i < Edge2Lv.size(); i++) {
+        res[i] = Edge{ cuboid.vertices[Edge2Lv[i][0]], cuboid.vertices[Edge2Lv[i][1]], cuboid_id };
+    }
     return res;
 }
 
@@ -11,6 +11,8 @@
 #include <Eigen/Sparse>
 #include <robin_hood.h>
 #include "Mesh.hpp"
+#include "EdgeTable.hpp"
+#include "IncidenceOperator.hpp"
 #include "Types.hpp"
 
 using Eigen::MatrixXf;
@@ -27,6 +29,8 @@ class QuantitiesOfInterest {
     private:
         const Mesh& mesh;
         Eigen::SparseMatrix<bool>  incidence;
+        EdgeTable edge_table;
+        bool edge_table_built = false;
     public:
         //Default constructor
         QuantitiesOfInterest();
@@ -39,6 +43,9 @@ class QuantitiesOfInterest {
 
         int interiorFaces() const;
 
+        // The number of edges which are not on the border
+        int interiorEdges() const;
+
         //The amount of elements connected to the given vertex.
         VertexConnectivity vertexConnectivity(uint32_t vertex) const;
 
@@ -63,18 +70,24 @@ class QuantitiesOfInterest {
         //maximal segments of the given start face.
         const std::vector<halfFace> getMaximalSegmentOf(halfFace currFace);
 
-        //Unsigned indicence matrix which shows connectivity between the half faces and their vertices.
-        const Eigen::SparseMatrix<bool>& ElementVertexIncidenceMatrix();
+        //Unsigned indicence matrix which shows connectivity between the elements and their vertices, optionally also their hanging vertices.
+        const Eigen::SparseMatrix<bool>& ElementVertexIncidenceMatrix(bool include_hanging = false);
 
         //Signed Vertex-Edge incidence matrix which shows whether the difference between the vertex coordinates >= origin
         const MatrixXf VertexEdgeIncidenceMatrix();
 
+        //The same signed incidence matrix as a sparse operator, which scales to large meshes.
+        IncidenceOperator VertexEdgeIncidenceOperator();
+
         //Get all 12 edges of the given cuboid.
-        const std::vector<Edge> getEdges(uint32_t cuboid_id) const;
+        std::array<Edge, 12> getEdges(uint32_t cuboid_id) const;
 
-        // Get all the edges of the mesh.
+        // Get all the edges of the mesh, ordered by their vertices.
         const std::vector<Edge> getAllEdges() const;
 
+        // Unique edges with their cuboids, built once per QuantitiesOfInterest.
+        const EdgeTable& getEdgeTable();
+
         //Destructor
         ~QuantitiesOfInterest();
 
@@ -0,0 +1,131 @@
+#include "RefinementHistory.hpp"
+#include <algorithm>
+#include <cassert>
+
+uint32_t RefinementHistory::addNode(uint32_t parent, uint32_t cuboid, uint32_t level)
+{
+    nodes.push_back({ parent, none, cuboid, level, 0.0f, Axis::x });
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void RefinementHistory::reset(size_t num_cuboids)
+{
+    nodes.clear();
+    leaf_of.resize(num_cuboids);
+    for (uint32_t c = 0; c < num_cuboids; c++) leaf_of[c] = addNode(none, c, 0);
+}
+
+void RefinementHistory::split(uint32_t cuboid, Axis axis, float coordinate, uint32_t new_cuboid)
+{
+    const uint32_t node = leaf_of[cuboid];
+    const uint32_t level = nodes[node].level + 1;
+    const uint32_t lower = addNode(node, cuboid, level);
+    const uint32_t top = addNode(node, new_cuboid, level);
+    nodes[node].first_child = lower;
+    nodes[node].cuboid = none;
+    nodes[node].coordinate = coordinate;
+    nodes[node].axis = axis;
+    if (new_cuboid >= leaf_of.size()) leaf_of.resize(new_cuboid + 1, none);
+    leaf_of[cuboid] = lower;
+    leaf_of[new_cuboid] = top;
+}
+
+bool RefinementHistory::merge(uint32_t keep, uint32_t removed)
+{
+    const uint32_t a = leaf_of[keep], b = leaf_of[removed];
+    const uint32_t parent = nodes[a].parent;
+    const bool siblings = parent != none && parent == nodes[b].parent;
+    // The children of a collapsed node are unreachable, retired leaves stay in their tree without a cuboid
+    nodes[a].cuboid = none;
+    nodes[b].cuboid = none;
+    if (siblings) {
+        nodes[parent].first_child = none;
+        nodes[parent].cuboid = keep;
+        leaf_of[keep] = parent;
+    }
+    else {
+        leaf_of[keep] = addNode(none, keep, 0);
+    }
+    leaf_of[removed] = none;
+    return siblings;
+}
+
+void RefinementHistory::rename(uint32_t from, uint32_t to)
+{
+    leaf_of[to] = leaf_of[from];
+    nodes[leaf_of[to]].cuboid = to;
+}
+
+void RefinementHistory::renumber(std::span<const uint32_t> new_ids)
+{
+    assert(new_ids.size() == leaf_of.size());
+    std::vector<uint32_t> new_leaf_of(leaf_of.size());
+    for (uint32_t c = 0; c < leaf_of.size(); c++) {
+        new_leaf_of[new_ids[c]] = leaf_of[c];
+        nodes[leaf_of[c]].cuboid = new_ids[c];
+    }
+    leaf_of = std::move(new_leaf_of);
+}
+
+uint32_t RefinementHistory::ancestor(uint32_t node, uint32_t level) const
+{
+    while (nodes[node].level > level) node = nodes[node].parent;
+    return node;
+}
+
+bool RefinementHistory::isAncestor(uint32_t ancestor_node, uint32_t node) const
+{
+    return nodes[ancestor_node].level <= nodes[node].level && ancestor(node, nodes[ancestor_node].level) == ancestor_node;
+}
+
+std::vector<uint32_t> RefinementHistory::roots() const
+{
+    std::vector<uint32_t> found;
+    for (uint32_t n = 0; n < nodes.size(); n++) {
+        if (nodes[n].parent == none) found.push_back(n);
+    }
+    return found;
+}
+
+uint32_t RefinementHistory::depth() const
+{
+    uint32_t max_level = 0;
+    for (const auto& node : nodes) max_level = std::max(max_level, node.level);
+    return max_level;
+}
+
+std::vector<uint32_t> RefinementHistory::level(uint32_t level) const
+{
+    // Reachable nodes only, the children of collapsed nodes are skipped
+    std::vector<uint32_t> found;
+    for (uint32_t n = 0; n < nodes.size(); n++) {
+        if (nodes[n].level != level) continue;
+        const uint32_t parent = nodes[n].parent;
+        if (parent == none || nodes[parent].first_child == n || nodes[parent].first_child + 1 == n) found.push_back(n);
+    }
+    return found;
+}
+
+std::vector<uint32_t> RefinementHistory::subtree(uint32_t node) const
+{
+    std::vector<uint32_t> found;
+    std::vector<uint32_t> stack = { node };
+    while (!stack.empty()) {
+        const uint32_t n = stack.back();
+        stack.pop_back();
+        found.push_back(n);
+        if (nodes[n].isLeaf()) continue;
+        stack.push_back(nodes[n].first_child + 1);
+        stack.push_back(nodes[n].first_child);
+    }
+    return found;
+}
+
+std::vector<uint32_t> RefinementHistory::cuboids(uint32_t node) const
+{
+    std::vector<uint32_t> found;
+    for (const auto n : subtree(node)) {
+        if (nodes[n].isLeaf() && nodes[n].cuboid != none) found.push_back(nodes[n].cuboid);
+    }
+    return found;
+}
@@ -0,0 +1,67 @@
+#ifndef _REFINEMENTHISTORY_HPP
+#define _REFINEMENTHISTORY_HPP
+#include "Types.hpp"
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+/*  RefinementHistory class, the forest of all splits applied to a mesh
+*   Every node is a cuboid that existed at some point. A split node has two children, the lower and the top part,
+*   leaves are the current cuboids. The roots are the cuboids the history was started with.
+*   Merging two siblings turns their parent back into a leaf, other merges start a new root and retire both leaves.
+*/
+class RefinementHistory
+{
+public:
+    static constexpr uint32_t none = static_cast<uint32_t>(-1);
+    struct HistoryNode
+    {
+        uint32_t parent;
+        // The lower child, the top child is first_child + 1. none for leaves
+        uint32_t first_child;
+        // Current cuboid id of a leaf, none for split nodes and retired leaves
+        uint32_t cuboid;
+        uint32_t level;
+        // The split of a split node
+        float coordinate;
+        Axis axis;
+        bool isLeaf() const { return first_child == none; }
+    };
+private:
+    std::vector<HistoryNode> nodes;
+    // Leaf node of every cuboid
+    std::vector<uint32_t> leaf_of;
+    uint32_t addNode(uint32_t parent, uint32_t cuboid, uint32_t level);
+public:
+    // Start a new history in which each of num_cuboids cuboids is a root
+    void reset(size_t num_cuboids);
+    // Cuboid has been split at coordinate along axis, the top part got new_cuboid
+    void split(uint32_t cuboid, Axis axis, float coordinate, uint32_t new_cuboid);
+    // Cuboids keep and removed have been merged into keep. Returns true if they were siblings, whose parent is now the leaf of keep
+    bool merge(uint32_t keep, uint32_t removed);
+    // Cuboid from got the id to
+    void rename(uint32_t from, uint32_t to);
+    // Forget all cuboids with an id of at least num_cuboids
+    void truncate(size_t num_cuboids) { leaf_of.resize(num_cuboids); }
+    // All cuboids have been renumbered, cuboid c got new_ids[c]
+    void renumber(std::span<const uint32_t> new_ids);
+
+    size_t size() const { return nodes.size(); }
+    const HistoryNode& operator[](uint32_t node) const { return nodes[node]; }
+    const std::vector<HistoryNode>& getNodes() const { return nodes; }
+    // Leaf node of a current cuboid
+    uint32_t leaf(uint32_t cuboid) const { return leaf_of[cuboid]; }
+    // The ancestor of node at a level not below it, walks up the tree in O(depth)
+    uint32_t ancestor(uint32_t node, uint32_t level) const;
+    bool isAncestor(uint32_t ancestor, uint32_t node) const;
+    std::vector<uint32_t> roots() const;
+    // Largest level of a node, roots are at level 0
+    uint32_t depth() const;
+    // All nodes at a level, in order of creation
+    std::vector<uint32_t> level(uint32_t level) const;
+    // The nodes of the subtree below node, including node, depth first with lower children first
+    std::vector<uint32_t> subtree(uint32_t node) const;
+    // The current cuboids descending from node
+    std::vector<uint32_t> cuboids(uint32_t node) const;
+};
+#endif
@@ -0,0 +1,72 @@
+#ifndef _SPACEFILLINGCURVE_HPP
+#define _SPACEFILLINGCURVE_HPP
+#include "Types.hpp"
+#include <algorithm>
+#include <stdint.h>
+
+/*
+* Space filling curves through the unit cube, used to number cuboids and vertices such that close ids are close in space.
+* Points are quantized to a grid of 2^21 cells per axis, the key is the index of the cell along the curve.
+*/
+enum class CurveOrder
+{
+    morton,
+    hilbert
+};
+
+constexpr uint32_t curve_bits = 21;
+
+static inline uint32_t curveCell(float c) {
+    constexpr float cells = static_cast<float>(uint32_t{ 1 } << curve_bits);
+    return static_cast<uint32_t>(std::clamp(c * cells, 0.0f, cells - 1.0f));
+}
+
+// Interleave the bits of the three coordinates, most significant bits first
+static inline uint64_t interleaveBits(const uint32_t (&cell)[3]) {
+    uint64_t key = 0;
+    for (int bit = curve_bits - 1; bit >= 0; bit--) {
+        for (int i = 0; i < 3; i++) key = (key << 1) | ((cell[i] >> bit) & 1);
+    }
+    return key;
+}
+
+static inline uint64_t mortonKey(const Vertex& p) {
+    const uint32_t cell[3] = { curveCell(p.x), curveCell(p.y), curveCell(p.z) };
+    return interleaveBits(cell);
+}
+
+/*
+* Hilbert index of a point, converts the cell to the transposed Hilbert index (Skilling, "Programming the Hilbert curve", 2004)
+* and interleaves it. Consecutive cells along the curve always share a face.
+*/
+static inline uint64_t hilbertKey(const Vertex& p) {
+    uint32_t cell[3] = { curveCell(p.x), curveCell(p.y), curveCell(p.z) };
+    constexpr uint32_t highest = uint32_t{ 1 } << (curve_bits - 1);
+    // Inverse undo of the rotations and reflections
+    for (uint32_t q = highest; q > 1; q >>= 1) {
+        const uint32_t mask = q - 1;
+        for (int i = 0; i < 3; i++) {
+            if (cell[i] & q) {
+                cell[0] ^= mask;
+            }
+            else {
+                const uint32_t swap = (cell[0] ^ cell[i]) & mask;
+                cell[0] ^= swap;
+                cell[i] ^= swap;
+            }
+        }
+    }
+    // Gray encode
+    for (int i = 1; i < 3; i++) cell[i] ^= cell[i - 1];
+    uint32_t flip = 0;
+    for (uint32_t q = highest; q > 1; q >>= 1) {
+        if (cell[2] & q) flip ^= q - 1;
+    }
+    for (int i = 0; i < 3; i++) cell[i] ^= flip;
+    return interleaveBits(cell);
+}
+
+static inline uint64_t curveKey(const Vertex& p, CurveOrder order) {
+    return order == CurveOrder::hilbert ? hilbertKey(p) : mortonKey(p);
+}
+#endif
@@ -177,8 +177,9 @@ inline void SplineMesh<Nx, Cx, Ny, Cy, Nz, Cz>::renderBasis(const std::string& f
     assert(samples > 0);
     // Render a spline basis
     for (int cube = 0; cube < mesh.getCuboids().size(); cube++) {
-        const auto bl_corner = mesh.getVertices()[mesh.getCuboids()[cube].v1];
-        const auto tr_corner = mesh.getVertices()[mesh.getCuboids()[cube].v7];
+        const Box& box = mesh.getBoxes()[static_cast<size_t>(cube)];
+        const auto bl_corner = box.min;
+        const auto tr_corner = box.max;
         const auto depth = tr_corner - bl_corner;
         // Render all points per cuboid
         for (size_t z_i = 0; z_i <= samples; z_i++)
@@ -289,6 +290,9 @@ inline LocalNullSpace SplineMesh<Nx, Cx, Ny, Cy, Nz, Cz>::LocalNullspace(uint32_
             }
         }
     });
+    // Gather the touching faces of all elements first, the twins on subdivided faces are then located in one batched find
+    std::vector<std::pair<int, halfFace>> faces;
+    std::vector<halfFace> twins;
     for (int index = 0; index < num; ++index)
     {
         // Find the local index of the vertex
@@ -296,27 +300,32 @@ inline LocalNullSpace SplineMesh<Nx, Cx, Ny, Cy, Nz, Cz>::LocalNullspace(uint32_
         const auto& vertices = mesh.getCuboids()[elem].vertices;
         const uint8_t local_index = std::find(vertices.begin(), vertices.end(), vertex) - vertices.begin();
         if (local_index > 7) return {};
-        // find the touching faces constraints
         for (uint8_t l_face : Lv2Hf[local_index]) {
             if (l_face < 1 || l_face > 3) continue;
             halfFace face = halfFace(elem, l_face);
-            halfFace twin = mesh.Twin(face);
-            if (twin.isSubdivided())
-            {
-                // find the halfface which contains the vertex
-                twin = *mesh.getSft().find(twin, mesh.getVertices()[vertex]);
-            }
-            if (twin.isBorder()) continue;
-            uint32_t second_index = std::find(elements.begin(), elements.end(), twin.getCuboid()) - elements.begin();
-            //find the given constraint
-            auto constraintFace = (*constraints.find(toKey({face,twin}))).second;
-            // iterate over all the columns
-            for (int col = 0; col < subMatSize_M; ++col) {
-                localMatrix.block(row, index * subMatSize_M + col, constraintFace.lowerConstraint.rows(), 1) = constraintFace.lowerConstraint.col(non_zeros[index * subMatSize_M + col]);
-                localMatrix.block(row, second_index * subMatSize_M + col, constraintFace.higherConstraint.rows(), 1) = constraintFace.higherConstraint.col(non_zeros[second_index * subMatSize_M + col]);
-            }
-            row += constraintFace.lowerConstraint.rows();
+            faces.push_back({ index, face });
+            twins.push_back(mesh.Twin(face));
+        }
+    }
+    // find the halffaces which contain the vertex, twins which are not subdivided are returned as is
+    const std::vector<Vertex> points(twins.size(), mesh.getVertices()[vertex]);
+    std::vector<halfFace> found(twins.size(), halfFace(border_id));
+    mesh.getSft().find(twins, points, found);
+    for (size_t f = 0; f < faces.size(); ++f)
+    {
+        const auto [element_index, face] = faces[f];
+        const halfFace twin = found[f];
+        // find the touching faces constraints
+        if (twin.isBorder()) continue;
+        uint32_t second_index = std::find(elements.begin(), elements.end(), twin.getCuboid()) - elements.begin();
+        //find the given constraint
+        auto constraintFace = (*constraints.find(toKey({face,twin}))).second;
+        // iterate over all the columns
+        for (int col = 0; col < subMatSize_M; ++col) {
+            localMatrix.block(row, element_index * subMatSize_M + col, constraintFace.lowerConstraint.rows(), 1) = constraintFace.lowerConstraint.col(non_zeros[element_index * subMatSize_M + col]);
+            localMatrix.block(row, second_index * subMatSize_M + col, constraintFace.higherConstraint.rows(), 1) = constraintFace.higherConstraint.col(non_zeros[second_index * subMatSize_M + col]);
         }
+        row += constraintFace.lowerConstraint.rows();
     }
     localMatrix.conservativeResize(row, Eigen::NoChange);
     auto QR = Eigen::FullPivHouseholderQR<Eigen::MatrixXf>(localMatrix.transpose());
@@ -189,9 +189,8 @@ inline float getDepth(std::pair<Vertex, Vertex> corners, Axis ax) {
 inline std::pair<Vertex, Vertex> getCorners(const Mesh& mesh, halfFace hf) {
     const uint32_t elem = hf.getCuboid();
     const uint8_t local_id = hf.getLocalId();
-    const auto bl_corner = mesh.getVertices()[mesh.getCuboids()[elem].v1];
-    const auto tr_corner = mesh.getVertices()[mesh.getCuboids()[elem].v7];
-    return { bl_corner, tr_corner };
+    const Box& box = mesh.getBoxes()[elem];
+    return { box.min, box.max };
 }
 
 template<Axis ax, int Nx, int Cx, int Ny=Nx, int Cy=Cx, int Nz=Nx, int Cz=Cx>
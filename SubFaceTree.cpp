@@ -1,4 +1,6 @@
 #include "SubFaceTree.hpp"
+#include <algorithm>
+#include <array>
 
 SubFaceIterator<SubFaceTree> SubFaceTree::begin(halfFace start_node) {
     assert(start_node.isSubdivided());
@@ -60,6 +62,7 @@ uint32_t SubFaceTree::insertNode(Node node)
     if (free_list_base == static_cast<uint32_t>(-1)) {
         new_index = nodes.size();
         nodes.push_back(node); 
+        is_free.resize(nodes.size(), 0);
     }
     else {
         uint32_t new_base = toNodeIndex(nodes[free_list_base].lower_child);
@@ -72,33 +75,37 @@ uint32_t SubFaceTree::insertNode(Node node)
             free_list_base = static_cast<uint32_t>(-1);
             free_list_head = static_cast<uint32_t>(-1);
         }
-
+        is_free[new_index] = 0;
     }
+    markChanged(halfFace(new_index, 6));
     return new_index;
 }
 
+// Coordinates of v indexed by axis, lets the tree descent pick the coordinate without branching on the split axis
+static inline std::array<float, 3> axisCoords(const Vertex& v) {
+    return { v.x, v.y, v.z };
+}
+
+static inline void prefetchNode(const Node* node) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(node);
+#else
+    (void)node;
+#endif
+}
+
 SubFaceIterator<SubFaceTree> SubFaceTree::find(halfFace start_node, const Vertex& v)
 {
     assert(start_node.isSubdivided());
+    const auto coords = axisCoords(v);
     bool is_lower = false;
     auto child = start_node;
     while (child.isSubdivided())
     {
-        float split = nodes[toNodeIndex(child)].split_coord;
-        switch (nodes[toNodeIndex(child)].split_axis)
-        {
-            case Axis::x :
-                is_lower = (eps + v.x <= split);
-                break;
-            case Axis::y :
-                is_lower = (eps + v.y <= split);
-                break;
-            case Axis::z :
-                is_lower = (eps + v.z <= split);
-                break;
-        }
+        const Node& node = nodes[toNodeIndex(child)];
+        is_lower = lattice.below(coords[static_cast<size_t>(node.getSplitAxis())], node.getSplitCoord());
         start_node = child;
-        child = is_lower ? nodes[toNodeIndex(start_node)].lower_child : nodes[toNodeIndex(start_node)].top_child;
+        child = is_lower ? node.lower_child : node.top_child;
     }
     return SubFaceIterator<SubFaceTree>(this, toNodeIndex(start_node), is_lower);
 }
@@ -106,29 +113,54 @@ SubFaceIterator<SubFaceTree> SubFaceTree::find(halfFace start_node, const Vertex
 SubFaceIterator<const SubFaceTree> SubFaceTree::find(halfFace start_node, const Vertex& v) const
 {
     assert(start_node.isSubdivided());
+    const auto coords = axisCoords(v);
     bool is_lower = false;
     auto child = start_node;
     while (child.isSubdivided())
     {
-        float split = nodes[toNodeIndex(child)].split_coord;
-        switch (nodes[toNodeIndex(child)].split_axis)
-        {
-        case Axis::x:
-            is_lower = (eps + v.x <= split);
-            break;
-        case Axis::y:
-            is_lower = (eps + v.y <= split);
-            break;
-        case Axis::z:
-            is_lower = (eps + v.z <= split);
-            break;
-        }
+        const Node& node = nodes[toNodeIndex(child)];
+        is_lower = lattice.below(coords[static_cast<size_t>(node.getSplitAxis())], node.getSplitCoord());
         start_node = child;
-        child = is_lower ? nodes[toNodeIndex(start_node)].lower_child : nodes[toNodeIndex(start_node)].top_child;
+        child = is_lower ? node.lower_child : node.top_child;
     }
     return SubFaceIterator<const SubFaceTree>(this, toNodeIndex(start_node), is_lower);
 }
 
+void SubFaceTree::find(std::span<const halfFace> roots, std::span<const Vertex> points, std::span<halfFace> out) const
+{
+    assert(roots.size() == points.size() && out.size() == points.size());
+    // Queries are descended in groups, one level of every query of a group at a time. The loads of the next
+    // nodes of the group are prefetched and overlap, instead of every level waiting for the load before it
+    constexpr size_t group_size = 16;
+    std::array<std::array<float, 3>, group_size> coords;
+    for (size_t first = 0; first < points.size(); first += group_size) {
+        const size_t count = std::min(group_size, points.size() - first);
+        size_t active = 0;
+        for (size_t i = 0; i < count; i++) {
+            coords[i] = axisCoords(points[first + i]);
+            out[first + i] = roots[first + i];
+            if (roots[first + i].isSubdivided()) {
+                prefetchNode(&nodes[toNodeIndex(roots[first + i])]);
+                active++;
+            }
+        }
+        while (active != 0) {
+            active = 0;
+            for (size_t i = 0; i < count; i++) {
+                halfFace& current = out[first + i];
+                if (!current.isSubdivided()) continue;
+                const Node& node = nodes[toNodeIndex(current)];
+                const bool is_lower = lattice.below(coords[i][static_cast<size_t>(node.getSplitAxis())], node.getSplitCoord());
+                current = is_lower ? node.lower_child : node.top_child;
+                if (current.isSubdivided()) {
+                    prefetchNode(&nodes[toNodeIndex(current)]);
+                    active++;
+                }
+            }
+        }
+    }
+}
+
 bool SubFaceTree::findVertexBorder(halfFace start_node, const Vertex& vertexToFind, const Axis splitAxis, halfFace& found) const
 {
     if (!start_node.isSubdivided()) {
@@ -140,30 +172,30 @@ bool SubFaceTree::findVertexBorder(halfFace start_node, const Vertex& vertexToFi
     while (child.isSubdivided())
     { 
         const Node nodeToCheck = nodes[toNodeIndex(child)];
-        const float split = nodeToCheck.split_coord;
-        switch (nodeToCheck.split_axis)
+        const float split = nodeToCheck.getSplitCoord();
+        switch (nodeToCheck.getSplitAxis())
         {
         case Axis::x:
             if (splitAxis == Axis::x)
             {
                 // Use or, since if we have already found a split at the right level, we still have found the vertex
-                vertexFound |= floatSame(vertexToFind.x, split);
+                vertexFound |= lattice.same(vertexToFind.x, split);
             }
-            lower = (vertexToFind.x <= split + eps);
+            lower = lattice.atMost(vertexToFind.x, split);
             break;
         case Axis::y:
             if (splitAxis == Axis::y)
             {
-                vertexFound |= floatSame(vertexToFind.y, split);
+                vertexFound |= lattice.same(vertexToFind.y, split);
             }
-            lower = (vertexToFind.y <= split + eps);
+            lower = lattice.atMost(vertexToFind.y, split);
             break;
         case Axis::z:
             if (splitAxis == Axis::z)
             {
-                vertexFound |= floatSame(vertexToFind.z, split);
+                vertexFound |= lattice.same(vertexToFind.z, split);
             }
-            lower = (vertexToFind.z <= split + eps);
+            lower = lattice.atMost(vertexToFind.z, split);
             break;
         }
         start_node = child;
@@ -186,21 +218,21 @@ bool SubFaceTree::findVertex(halfFace start_node, const Vertex& vertexToFind) co
     {
         bool vertexFound = false;
         const Node nodeToCheck = nodes[toNodeIndex(child)];
-        const float split = nodeToCheck.split_coord;
+        const float split = nodeToCheck.getSplitCoord();
 
-        switch (nodeToCheck.split_axis)
+        switch (nodeToCheck.getSplitAxis())
         {
         case Axis::x:
-            lower = (eps + vertexToFind.x <= split);
-            vertexFound = floatSame(vertexToFind.x, split);
+            lower = lattice.below(vertexToFind.x, split);
+            vertexFound = lattice.same(vertexToFind.x, split);
             break;
         case Axis::y:
-            lower = (eps + vertexToFind.y <= split);
-            vertexFound = floatSame(vertexToFind.y, split);
+            lower = lattice.below(vertexToFind.y, split);
+            vertexFound = lattice.same(vertexToFind.y, split);
             break;
         case Axis::z:
-            lower = (eps + vertexToFind.z <= split);
-            vertexFound = floatSame(vertexToFind.z, split);
+            lower = lattice.below(vertexToFind.z, split);
+            vertexFound = lattice.same(vertexToFind.z, split);
             break;
         }
 
@@ -270,6 +302,7 @@ HalfFacePair SubFaceTree::splitTree(const halfFace tree_head, const Axis split_a
             return split_point.z;
         }
     }();
+    markChanged(tree_head);
     
     if (!tree_head.isSubdivided()) {
         assert(!tree_head.isBorder());
@@ -282,9 +315,9 @@ HalfFacePair SubFaceTree::splitTree(const halfFace tree_head, const Axis split_a
     halfFace top_head{border_id};
     const auto node_idx = toNodeIndex(tree_head);
     const Node node = nodes[node_idx];
-    if (node.split_axis == split_axis)
+    if (node.getSplitAxis() == split_axis)
     {
-        if (floatSame(split, node.split_coord))
+        if (lattice.same(split, node.getSplitCoord()))
         {
             // Split point is exactly on this nodes[node_idx]
             // It is no longer needed so remove it
@@ -295,7 +328,7 @@ HalfFacePair SubFaceTree::splitTree(const halfFace tree_head, const Axis split_a
             updateSubTreeTwins(top_head, lower, higher, split_point, F2f);
             return {lower_head, top_head};
         }
-        if (split < nodes[node_idx].split_coord)
+        if (split < nodes[node_idx].getSplitCoord())
         {
             // Split point is on the lower side
             // The current node can be shifted to the top side
@@ -328,14 +361,13 @@ HalfFacePair SubFaceTree::splitTree(const halfFace tree_head, const Axis split_a
         const auto higher_ret = splitTree(node.top_child, split_axis, split_point, lower, higher, F2f);
         nodes[node_idx].lower_child = lower_ret.first;
         copy.lower_child = lower_ret.second;
-        top_head = halfFace(nodes.size(), 6);
-        updateParent(lower_ret.second, halfFace(toNodeIndex(top_head), 6));
-        updateParent(lower_ret.first, halfFace(toNodeIndex(lower_head), 6));
         nodes[node_idx].top_child = higher_ret.first;
         copy.top_child = higher_ret.second;
+        top_head = halfFace(insertNode(copy), 6);
+        updateParent(lower_ret.second, halfFace(toNodeIndex(top_head), 6));
+        updateParent(lower_ret.first, halfFace(toNodeIndex(lower_head), 6));
         updateParent(higher_ret.second, halfFace(toNodeIndex(top_head), 7)); 
         updateParent(higher_ret.first, halfFace(toNodeIndex(lower_head), 7));
-        nodes.push_back(copy);
     }
     return {lower_head, top_head};
 }
@@ -343,6 +375,12 @@ HalfFacePair SubFaceTree::splitTree(const halfFace tree_head, const Axis split_a
 void SubFaceTree::removeNode(uint32_t node_index) 
 {
     assert(!nodes.empty());
+    // The tree around the node changes, the node itself is no longer threaded
+    markSlotChanged(nodes[node_index].parent);
+    markChanged(nodes[node_index].lower_child);
+    markChanged(nodes[node_index].top_child);
+    is_free.resize(nodes.size(), 0);
+    is_free[node_index] = 1;
     if (free_list_base == static_cast<uint32_t>(-1)) { free_list_base = node_index;
 }
     if (free_list_head != static_cast<uint32_t>(-1)) {
@@ -351,6 +389,175 @@ void SubFaceTree::removeNode(uint32_t node_index)
     free_list_head = node_index;
 }
 
+size_t SubFaceTree::numFreeNodes() const
+{
+    size_t count = 0;
+    for (uint32_t n = free_list_base; n != static_cast<uint32_t>(-1); n = toNodeIndex(nodes[n].lower_child)) {
+        count++;
+        if (n == free_list_head) break;
+    }
+    return count;
+}
+
+void SubFaceTree::compact(std::vector<halfFace>& F2f)
+{
+    // Number the nodes of every tree depth first, in the order of the faces owning them
+    std::vector<uint32_t> new_index(nodes.size(), static_cast<uint32_t>(-1));
+    std::vector<uint32_t> order;
+    order.reserve(nodes.size() - numFreeNodes());
+    std::vector<uint32_t> stack;
+    for (const auto head : F2f) {
+        if (!head.isSubdivided()) continue;
+        stack.assign(1, toNodeIndex(head));
+        while (!stack.empty()) {
+            const uint32_t n = stack.back();
+            stack.pop_back();
+            new_index[n] = static_cast<uint32_t>(order.size());
+            order.push_back(n);
+            if (nodes[n].top_child.isSubdivided()) stack.push_back(toNodeIndex(nodes[n].top_child));
+            if (nodes[n].lower_child.isSubdivided()) stack.push_back(toNodeIndex(nodes[n].lower_child));
+        }
+    }
+    const auto remap = [&](const halfFace hf) {
+        return hf.isSubdivided() ? halfFace(new_index[toNodeIndex(hf)], hf.getLocalId()) : hf;
+    };
+    std::vector<Node> compacted;
+    compacted.reserve(order.size());
+    for (const auto n : order) {
+        Node node = nodes[n];
+        node.parent = remap(node.parent);
+        node.lower_child = remap(node.lower_child);
+        node.top_child = remap(node.top_child);
+        compacted.push_back(node);
+    }
+    for (auto& head : F2f) head = remap(head);
+    nodes = std::move(compacted);
+    free_list_base = static_cast<uint32_t>(-1);
+    free_list_head = static_cast<uint32_t>(-1);
+    is_free.assign(nodes.size(), 0);
+    threaded = false;
+    thread_all = true;
+    threadLeaves();
+}
+
+void SubFaceTree::setFreeList(uint32_t base, uint32_t head)
+{
+    free_list_base = base;
+    free_list_head = head;
+    is_free.assign(nodes.size(), 0);
+    for (uint32_t n = free_list_base; n != static_cast<uint32_t>(-1); n = toNodeIndex(nodes[n].lower_child)) {
+        is_free[n] = 1;
+        if (n == free_list_head) break;
+    }
+    threaded = false;
+    thread_all = true;
+}
+
+std::pair<uint32_t, uint32_t> SubFaceTree::threadSubtree(uint32_t root)
+{
+    // Depth first with the lower child first visits the leaves in iteration order
+    uint32_t first = static_cast<uint32_t>(-1);
+    uint32_t previous = static_cast<uint32_t>(-1);
+    auto& stack = thread_stack;
+    stack.assign(1, root);
+    while (!stack.empty()) {
+        const uint32_t n = stack.back();
+        stack.pop_back();
+        const Node& node = nodes[n];
+        if (node.top_child.isSubdivided()) stack.push_back(toNodeIndex(node.top_child));
+        else stack.push_back(n << 1 | 1 | 0x80000000);
+        if (node.lower_child.isSubdivided()) stack.push_back(toNodeIndex(node.lower_child));
+        else stack.push_back(n << 1 | 0x80000000);
+        // Leaves are pushed with the highest bit set and linked when popped
+        while (!stack.empty() && (stack.back() & 0x80000000)) {
+            const uint32_t leaf = stack.back() & 0x7FFFFFFF;
+            stack.pop_back();
+            if (previous != static_cast<uint32_t>(-1)) next_leaf[previous >> 1][previous & 1] = leaf;
+            else first = leaf;
+            previous = leaf;
+        }
+    }
+    return { first, previous };
+}
+
+void SubFaceTree::threadSlot(halfFace slot)
+{
+    const uint32_t slot_node = toNodeIndex(slot);
+    const halfFace content = isHigher(slot) ? nodes[slot_node].top_child : nodes[slot_node].lower_child;
+    const uint32_t slot_leaf = slot_node << 1 | (isHigher(slot) ? 1 : 0);
+    const auto [first, last] = content.isSubdivided() ? threadSubtree(toNodeIndex(content)) : std::pair{ slot_leaf, slot_leaf };
+    // The leaf before the slot is the last leaf of the lower sibling of the first top slot above it
+    for (halfFace up = slot; up.isSubdivided(); up = nodes[toNodeIndex(up)].parent) {
+        if (!isHigher(up)) continue;
+        uint32_t before = toNodeIndex(up) << 1;
+        for (halfFace child = nodes[toNodeIndex(up)].lower_child; child.isSubdivided(); child = nodes[toNodeIndex(child)].top_child) {
+            before = toNodeIndex(child) << 1 | 1;
+        }
+        next_leaf[before >> 1][before & 1] = first;
+        break;
+    }
+    // The leaf after it is the first leaf of the top sibling of the first lower slot above it
+    uint32_t after = static_cast<uint32_t>(-1);
+    for (halfFace up = slot; up.isSubdivided(); up = nodes[toNodeIndex(up)].parent) {
+        if (isHigher(up)) continue;
+        after = toNodeIndex(up) << 1 | 1;
+        for (halfFace child = nodes[toNodeIndex(up)].top_child; child.isSubdivided(); child = nodes[toNodeIndex(child)].lower_child) {
+            after = toNodeIndex(child) << 1;
+        }
+        break;
+    }
+    next_leaf[last >> 1][last & 1] = after;
+}
+
+void SubFaceTree::threadLeaves()
+{
+    if (threaded) return;
+    next_leaf.resize(nodes.size());
+    is_free.resize(nodes.size(), 0);
+    // Nodes on the free list hold stale links, they must not be threaded
+    if (thread_all) {
+        for (uint32_t n = 0; n < nodes.size(); n++) {
+            if (is_free[n] || nodes[n].parent.isSubdivided()) continue;
+            const uint32_t last = threadSubtree(n).second;
+            next_leaf[last >> 1][last & 1] = static_cast<uint32_t>(-1);
+        }
+    }
+    else {
+        is_changed.resize(nodes.size(), 0);
+        std::erase_if(changed_nodes, [&](uint32_t n) {
+            if (n >= nodes.size() || is_free[n] || is_changed[n]) return true;
+            is_changed[n] = 1;
+            return false;
+        });
+        // A change below a changed node is threaded together with the subtree of that node
+        const auto below_changed = [&](halfFace slot) {
+            for (; slot.isSubdivided(); slot = nodes[toNodeIndex(slot)].parent) {
+                if (is_changed[toNodeIndex(slot)]) return true;
+            }
+            return false;
+        };
+        for (const uint32_t n : changed_nodes) {
+            const halfFace parent = nodes[n].parent;
+            if (below_changed(parent)) continue;
+            if (parent.isSubdivided()) {
+                threadSlot(parent);
+            }
+            else {
+                const uint32_t last = threadSubtree(n).second;
+                next_leaf[last >> 1][last & 1] = static_cast<uint32_t>(-1);
+            }
+        }
+        for (const halfFace slot : changed_slots) {
+            if (toNodeIndex(slot) < nodes.size() && !is_free[toNodeIndex(slot)] && !below_changed(slot)) threadSlot(slot);
+        }
+        for (const uint32_t n : changed_nodes) is_changed[n] = 0;
+    }
+    changed_nodes.clear();
+    changed_slots.clear();
+    thread_all = false;
+    threaded = true;
+}
+
 SubFaceTree::~SubFaceTree()
 {
     
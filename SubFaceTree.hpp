@@ -2,7 +2,9 @@
 #define _SUBFACETREE_HPP
 #include "Types.hpp"
 #include <cassert>
+#include <array>
 #include <vector>
+#include <span>
 #include <type_traits>
 #include <numeric>
 #include <stdint.h>
@@ -25,9 +27,38 @@ class SubFaceTree
 private:
     uint32_t free_list_base = static_cast<uint32_t>(-1);
     uint32_t free_list_head = static_cast<uint32_t>(-1);
+    // The leaves of every tree threaded in iteration order: the leaf after child side (0 lower, 1 top) of node n is
+    // next_leaf[n][side], as node << 1 | side, -1 after the last leaf. Only valid if threaded, every change to the structure clears it
+    std::vector<std::array<uint32_t, 2>> next_leaf;
+    bool threaded = true;
+    // Nodes whose subtree changed and child slots that now hold a different leaf, since the leaves were last threaded.
+    // With thread_all every tree is threaded again
+    std::vector<uint32_t> changed_nodes;
+    std::vector<halfFace> changed_slots;
+    bool thread_all = false;
+    // Reused by threadLeaves and threadSubtree, which run after every split and merge
+    std::vector<uint32_t> thread_stack;
+    std::vector<uint8_t> is_changed;
+    // 1 for the nodes on the free list
+    std::vector<uint8_t> is_free;
+    void markChanged(halfFace node) { threaded = false; if (node.isSubdivided() && !thread_all) changed_nodes.push_back(toNodeIndex(node)); limitChanges(); }
+    void markSlotChanged(halfFace slot) { threaded = false; if (slot.isSubdivided() && !thread_all) changed_slots.push_back(slot); limitChanges(); }
+    // After many changes one pass over all nodes is cheaper than threading every change on its own, the changes are no longer recorded
+    void limitChanges() {
+        if (changed_nodes.size() + changed_slots.size() <= nodes.size() / 8 + 64) return;
+        thread_all = true;
+        changed_nodes.clear();
+        changed_slots.clear();
+    }
+    // Thread the leaves below node, returns its first and last leaf
+    std::pair<uint32_t, uint32_t> threadSubtree(uint32_t node);
+    // Thread the leaves in a child slot and link them to the leaves before and after the slot, costs the size of the slot plus the depth
+    void threadSlot(halfFace slot);
     void updateSubTreeTwins(const halfFace head, const halfFace old_hf, const halfFace new_hf, const Vertex& split_point, std::vector<halfFace>& F2f);
 public:
     std::vector<Node> nodes; 
+    // Coordinate lattice of the mesh, decides how split coordinates are compared
+    Lattice lattice;
     void updateParent(const halfFace node, halfFace new_parent) { if (!node.isSubdivided()) return; nodes[toNodeIndex(node)].parent = new_parent; }
     SubFaceTree(/* args */) = default;
     SubFaceTree(const SubFaceTree&) = delete; // prevent expensive accidental copies
@@ -35,6 +66,19 @@ public:
     // Find the halface which bounds the vertex v, in the subfacetree starting at start_node
     SubFaceIterator<SubFaceTree> find(halfFace start_node, const Vertex& v);
     SubFaceIterator<const SubFaceTree> find(halfFace start_node, const Vertex& v) const;
+    /*
+    * Find many points at once, out[i] is the leaf bounding points[i] in the tree starting at roots[i]. Roots that are
+    * not subdivided are copied to out. Descends groups of queries in lockstep, faster than one find per point on large meshes.
+    */
+    void find(std::span<const halfFace> roots, std::span<const Vertex> points, std::span<halfFace> out) const;
+    /*
+    * Call callback(leaf) for every leaf of the tree starting at root that overlaps rect with a positive area, in iteration order.
+    * rect is a box in the plane of the face, its extent along the normal of the face is ignored. Subtrees on the other side
+    * of a split are skipped, so the cost depends on the leaves in rect instead of the size of the tree. A root that is not
+    * subdivided is passed to callback as is.
+    */
+    template<typename Callback>
+    void query(halfFace root, const Box& rect, Callback&& callback) const;
 
     /* 
         [description] searches the tree for the vertex that we need to find starting from start_node half face.
@@ -46,7 +90,27 @@ public:
     // Split a SubFaceTree in two along a split, returns the two start nodes, also splits twin faces automatically if necassary
     HalfFacePair splitTree(const halfFace tree_head, const Axis split_axis, const Vertex& split_point, const halfFace lower, const halfFace higher, std::vector<halfFace>& F2f);
     void removeNode(uint32_t node_index);
+    // Every node is allocated here, nodes on the free list are reused first
     uint32_t insertNode(Node node);
+    // Number of nodes on the free list
+    size_t numFreeNodes() const;
+    /*
+    * Store every tree contiguously in depth first order, in the order of the faces in F2f, and drop the free nodes.
+    * Rewrites the tree heads in F2f and all parent and child links.
+    */
+    void compact(std::vector<halfFace>& F2f);
+    // First and last entry of the list of free nodes, -1 if the list is empty
+    std::pair<uint32_t, uint32_t> getFreeList() const { return { free_list_base, free_list_head }; }
+    void setFreeList(uint32_t base, uint32_t head);
+    /*
+    * Thread the leaves of the subtrees changed since the last call, so iterators step to the next leaf in O(1) instead of
+    * climbing the tree. Costs the size of the changed subtrees plus their depth, or one pass over all nodes after many changes.
+    * The mesh calls it at the end of batches of changes, iterators climb the tree until then.
+    */
+    void threadLeaves();
+    bool isThreaded() const { return threaded; }
+    // Next leaf as node << 1 | side, only valid if threaded
+    uint32_t nextLeaf(uint32_t node_index, bool at_lower) const { return next_leaf[node_index][at_lower ? 0 : 1]; }
     // Obtain an iterator to iterate through the subHalfFace tree starting at the start node
     SubFaceIterator<SubFaceTree> begin(halfFace start_node);
     static SubFaceIterator<SubFaceTree> end();
@@ -60,6 +124,28 @@ static inline bool isHigher(halfFace face) {
     return face.getLocalId() == 7;
 }
 
+template<typename Callback>
+void SubFaceTree::query(halfFace root, const Box& rect, Callback&& callback) const
+{
+    const std::array<float, 3> rect_min = { rect.min.x, rect.min.y, rect.min.z };
+    const std::array<float, 3> rect_max = { rect.max.x, rect.max.y, rect.max.z };
+    std::vector<halfFace> stack = { root };
+    while (!stack.empty()) {
+        const halfFace current = stack.back();
+        stack.pop_back();
+        if (!current.isSubdivided()) {
+            callback(current);
+            continue;
+        }
+        const Node& node = nodes[toNodeIndex(current)];
+        const size_t axis = static_cast<size_t>(node.getSplitAxis());
+        const float split = node.getSplitCoord();
+        // Pushed top first, so the lower side is visited first
+        if (lattice.below(split, rect_max[axis])) stack.push_back(node.top_child);
+        if (lattice.below(rect_min[axis], split)) stack.push_back(node.lower_child);
+    }
+}
+
 template<typename TreeType>
 class SubFaceIterator
 {
@@ -82,6 +168,12 @@ public:
         return other.node_index != node_index || other.at_lower != at_lower;
     }
     auto& operator++() {
+        if (tree->isThreaded()) {
+            const uint32_t next = tree->nextLeaf(node_index, at_lower);
+            node_index = next == static_cast<uint32_t>(-1) ? next : next >> 1;
+            at_lower = next != static_cast<uint32_t>(-1) && (next & 1) == 0;
+            return *this;
+        }
         // If we are at the higher child of a node
         if (!at_lower) {
             if (!tree->nodes[node_index].parent.isSubdivided()) {
@@ -3,6 +3,10 @@
 #include <utility>
 #include <array>
 #include <iostream>
+#include <cmath>
+#include <bit>
+#include <cassert>
+#include <stdint.h>
 
 // Constants
 constexpr float eps = 1e-7;
@@ -128,13 +132,123 @@ enum class Axis
     z
 };
 
+// Coordinate of v along axis
+static inline float axisCoord(const Vertex& v, Axis axis) {
+	switch (axis)
+	{
+	case Axis::x: return v.x;
+	case Axis::y: return v.y;
+	default: return v.z;
+	}
+}
+static inline float& axisCoord(Vertex& v, Axis axis) {
+	switch (axis)
+	{
+	case Axis::x: return v.x;
+	case Axis::y: return v.y;
+	default: return v.z;
+	}
+}
+
+/*
+* Axis aligned box, the bounding box of a cuboid is given by its vertices v1 and v7
+*/
+struct Box
+{
+	Vertex min, max;
+	// Closed containment test
+	bool contains(const Vertex& p) const {
+		return p >= min && max >= p;
+	}
+	Vertex center() const {
+		return (min + max) / 2;
+	}
+};
+
+/*
+* A single split of a cuboid along a plane orthogonal to axis at coordinate
+*/
+struct SplitRequest
+{
+	uint32_t cuboid;
+	Axis axis;
+	float coordinate;
+};
+
+/*
+* Optional dyadic lattice for the coordinates of a mesh.
+* With levels > 0 every coordinate is snapped to a multiple of 2^-levels, these are exactly representable as float,
+* so coordinates can be compared exactly and converted to integer lattice coordinates for hashing.
+* With levels == 0 (the default) coordinates are arbitrary floats compared up to eps.
+*/
+struct Lattice
+{
+	// At most 24 levels, the precision of a float in [0, 1]. The coordinates are stored as float, so deeper lattices would need
+	// integer coordinates throughout the mesh, Mesh throws for more levels
+	static constexpr uint8_t max_levels = 24;
+	uint8_t levels = 0;
+	bool enabled() const {
+		return levels != 0;
+	}
+	float scale() const {
+		return static_cast<float>(uint32_t{ 1 } << levels);
+	}
+	// Integer lattice coordinate of a coordinate in [0, 1]
+	uint32_t toLattice(float c) const {
+		return static_cast<uint32_t>(std::lround(c * scale()));
+	}
+	float fromLattice(uint32_t c) const {
+		return static_cast<float>(c) / scale();
+	}
+	float snap(float c) const {
+		return enabled() ? fromLattice(toLattice(c)) : c;
+	}
+	Vertex snap(const Vertex& v) const {
+		return { snap(v.x), snap(v.y), snap(v.z) };
+	}
+	bool same(float a, float b) const {
+		return enabled() ? a == b : floatSame(a, b);
+	}
+	bool sameVertex(const Vertex& a, const Vertex& b) const {
+		return enabled() ? (a.x == b.x && a.y == b.y && a.z == b.z) : a == b;
+	}
+	// Coordinates closer than this are the same, on the lattice they have to be equal
+	float tolerance() const {
+		return enabled() ? 0.0f : eps;
+	}
+	// Coordinate a is strictly below split
+	bool below(float a, float split) const {
+		return enabled() ? a < split : eps + a <= split;
+	}
+	// Coordinate a is below or on split
+	bool atMost(float a, float split) const {
+		return enabled() ? a <= split : a <= split + eps;
+	}
+};
+
 //Node struct
-struct Node
+/*
+* Node of a subface tree, packed in 16 bytes so a node never crosses a cache line.
+* Split coordinates lie in [0, 1], where the two highest bits of a float are always zero, so the split axis is stored in them.
+* Not an aggregate, the constructor packs the split. -0.0f is stored as 0.0f, its sign bit would overwrite the axis.
+*/
+struct alignas(16) Node
 {
-	halfFace parent;
-	float split_coord;
-	Axis split_axis;
+private:
+	uint32_t split;
+public:
 	halfFace lower_child;
 	halfFace top_child;
+	halfFace parent;
+	Node(halfFace parent_hf, float split_coord, Axis split_axis, halfFace lower, halfFace top)
+		: split(std::bit_cast<uint32_t>(split_coord + 0.0f) | (static_cast<uint32_t>(split_axis) << 30)), lower_child(lower), top_child(top), parent(parent_hf) {
+		assert(split_coord >= 0.0f && split_coord < 2.0f);
+	}
+	float getSplitCoord() const {
+		return std::bit_cast<float>(split & 0x3FFFFFFF);
+	}
+	Axis getSplitAxis() const {
+		return static_cast<Axis>(split >> 30);
+	}
 };
 #endif
\ No newline at end of file
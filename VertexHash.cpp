@@ -0,0 +1,78 @@
+#include "VertexHash.hpp"
+#include <cmath>
+
+VertexHash::Cell VertexHash::cellOf(const Vertex& v) const
+{
+    const float s = scale();
+    return { static_cast<int32_t>(std::floor(v.x * s)), static_cast<int32_t>(std::floor(v.y * s)), static_cast<int32_t>(std::floor(v.z * s)) };
+}
+
+void VertexHash::build(const VertexStore& vertices, Lattice mesh_lattice)
+{
+    clear();
+    lattice = mesh_lattice;
+    heads.reserve(vertices.size());
+    next.reserve(vertices.size());
+    for (uint32_t v = 0; v < vertices.size(); v++) {
+        insert(v, vertices[v]);
+    }
+}
+
+void VertexHash::clear()
+{
+    heads.clear();
+    next.clear();
+}
+
+void VertexHash::insert(uint32_t v, const Vertex& position)
+{
+    if (next.size() <= v) next.resize(v + 1, none);
+    auto [it, inserted] = heads.try_emplace(cellOf(position), v);
+    next[v] = inserted ? none : it->second;
+    it->second = v;
+}
+
+void VertexHash::erase(uint32_t v, const Vertex& position)
+{
+    const auto it = heads.find(cellOf(position));
+    assert(it != heads.end());
+    if (it->second == v) {
+        if (next[v] == none) heads.erase(it);
+        else it->second = next[v];
+        return;
+    }
+    uint32_t previous = it->second;
+    while (next[previous] != v) {
+        assert(next[previous] != none);
+        previous = next[previous];
+    }
+    next[previous] = next[v];
+}
+
+uint32_t VertexHash::find(const Vertex& position, const VertexStore& vertices) const
+{
+    const Cell cell = cellOf(position);
+    // Neighbouring cells that may hold a position within eps, only without a lattice
+    int32_t lower[3] = { 0, 0, 0 }, upper[3] = { 0, 0, 0 };
+    if (!lattice.enabled()) {
+        const float s = scale();
+        const float coords[3] = { position.x, position.y, position.z };
+        const int32_t cells[3] = { cell.x, cell.y, cell.z };
+        for (int i = 0; i < 3; i++) {
+            if (coords[i] - eps < static_cast<float>(cells[i]) / s) lower[i] = -1;
+            if (coords[i] + eps >= static_cast<float>(cells[i] + 1) / s) upper[i] = 1;
+        }
+    }
+    for (int32_t dz = lower[2]; dz <= upper[2]; dz++) {
+        for (int32_t dy = lower[1]; dy <= upper[1]; dy++) {
+            for (int32_t dx = lower[0]; dx <= upper[0]; dx++) {
+                const auto it = heads.find({ cell.x + dx, cell.y + dy, cell.z + dz });
+                if (it == heads.end()) continue;
+                for (uint32_t v = it->second; v != none; v = next[v]) {
+                    if (lattice.sameVertex(vertices[v], position)) return v;
+                }
+            }
+        }
+    }
+    return none;
+}
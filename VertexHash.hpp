@@ -0,0 +1,48 @@
+#ifndef _VERTEXHASH_HPP
+#define _VERTEXHASH_HPP
+#include "Types.hpp"
+#include "VertexStore.hpp"
+#include <robin_hood.h>
+#include <vector>
+#include <stdint.h>
+
+/*  VertexHash class, finds the vertex at a position in constant time
+*   The coordinates are quantized to cells, on the lattice of the mesh when it has one and otherwise to cells of 2^-20.
+*   Every cell stores the last inserted vertex, the other vertices of the cell are chained through next.
+*   Without a lattice a position within eps of a cell boundary is also looked up in the neighbouring cell.
+*/
+class VertexHash
+{
+private:
+    struct Cell
+    {
+        int32_t x, y, z;
+        bool operator==(const Cell& other) const { return x == other.x && y == other.y && z == other.z; }
+    };
+    struct CellHash
+    {
+        size_t operator()(const Cell& cell) const {
+            return robin_hood::hash_int((static_cast<uint64_t>(static_cast<uint32_t>(cell.x)) * 0x9E3779B97F4A7C15ull) ^ (static_cast<uint64_t>(static_cast<uint32_t>(cell.y)) << 21) ^ (static_cast<uint64_t>(static_cast<uint32_t>(cell.z)) << 42));
+        }
+    };
+    static constexpr uint32_t none = static_cast<uint32_t>(-1);
+    static constexpr float float_cells = static_cast<float>(1 << 20);
+    robin_hood::unordered_flat_map<Cell, uint32_t, CellHash> heads;
+    // Next vertex in the same cell, none at the end of the chain
+    std::vector<uint32_t> next;
+    Lattice lattice;
+    float scale() const { return lattice.enabled() ? lattice.scale() : float_cells; }
+    Cell cellOf(const Vertex& v) const;
+public:
+    VertexHash() = default;
+    // Hash all vertices, the positions are compared on the given lattice
+    void build(const VertexStore& vertices, Lattice mesh_lattice);
+    void clear();
+    // Add vertex v at position
+    void insert(uint32_t v, const Vertex& position);
+    // Remove vertex v, which was inserted at position
+    void erase(uint32_t v, const Vertex& position);
+    // Vertex at the same position as position, -1 if there is none
+    uint32_t find(const Vertex& position, const VertexStore& vertices) const;
+};
+#endif
@@ -0,0 +1,44 @@
+#ifndef _VERTEXSTAR_HPP
+#define _VERTEXSTAR_HPP
+#include "Parallel.hpp"
+#include <array>
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+/*  VertexStar class, the cuboids around every vertex in compressed rows (CSR)
+*   The star of a vertex holds every cuboid touching it, also the cuboids on which it is a hanging vertex
+*   in the middle of a face or an edge, so it has 1 to 8 cuboids.
+*/
+class VertexStar
+{
+private:
+    // The star of vertex v is star_cuboids[offsets[v]] up to star_cuboids[offsets[v + 1]]
+    std::vector<uint32_t> offsets = { 0 };
+    std::vector<uint32_t> star_cuboids;
+public:
+    size_t size() const { return offsets.size() - 1; }
+    std::span<const uint32_t> cuboids(uint32_t v) const { return { star_cuboids.data() + offsets[v], star_cuboids.data() + offsets[v + 1] }; }
+    const std::vector<uint32_t>& getOffsets() const { return offsets; }
+    const std::vector<uint32_t>& getCuboids() const { return star_cuboids; }
+    /*
+    * Build the stars of num_vertices vertices in parallel, star(v, cuboids) writes the star of v in cuboids and returns its size
+    */
+    template<typename StarFn>
+    void build(size_t num_vertices, StarFn&& star, unsigned num_threads = 0);
+};
+
+template<typename StarFn>
+void VertexStar::build(size_t num_vertices, StarFn&& star, unsigned num_threads)
+{
+    // Compute the stars once in a fixed size buffer, then pack them
+    std::vector<std::array<uint32_t, 8>> stars(num_vertices);
+    std::vector<uint8_t> sizes(num_vertices);
+    parallelFor(num_vertices, [&](size_t v) { sizes[v] = static_cast<uint8_t>(star(static_cast<uint32_t>(v), stars[v])); }, num_threads);
+    offsets.resize(num_vertices + 1);
+    offsets[0] = 0;
+    for (size_t v = 0; v < num_vertices; v++) offsets[v + 1] = offsets[v] + sizes[v];
+    star_cuboids.resize(offsets.back());
+    parallelFor(num_vertices, [&](size_t v) { std::copy(stars[v].begin(), stars[v].begin() + sizes[v], star_cuboids.begin() + offsets[v]); }, num_threads);
+}
+#endif
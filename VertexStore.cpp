@@ -0,0 +1,73 @@
+#include "VertexStore.hpp"
+#include <algorithm>
+#include <limits>
+
+Box VertexStore::boundingBox() const
+{
+    // Separate minima and maxima per lane, a single running minimum is a dependency chain the compiler can not vectorize
+    constexpr size_t lanes = 8;
+    constexpr float inf = std::numeric_limits<float>::infinity();
+    const size_t n = size();
+    Box box{ { inf, inf, inf }, { -inf, -inf, -inf } };
+    for (const Axis axis : { Axis::x, Axis::y, Axis::z }) {
+        const float* __restrict c = coords(axis);
+        float lo[lanes], hi[lanes];
+        for (size_t l = 0; l < lanes; l++) {
+            lo[l] = inf;
+            hi[l] = -inf;
+        }
+        size_t i = 0;
+        for (; i + lanes <= n; i += lanes) {
+            for (size_t l = 0; l < lanes; l++) {
+                lo[l] = c[i + l] < lo[l] ? c[i + l] : lo[l];
+                hi[l] = c[i + l] > hi[l] ? c[i + l] : hi[l];
+            }
+        }
+        for (; i < n; i++) {
+            lo[0] = std::min(lo[0], c[i]);
+            hi[0] = std::max(hi[0], c[i]);
+        }
+        for (size_t l = 0; l < lanes; l++) {
+            axisCoord(box.min, axis) = std::min(axisCoord(box.min, axis), lo[l]);
+            axisCoord(box.max, axis) = std::max(axisCoord(box.max, axis), hi[l]);
+        }
+    }
+    return box;
+}
+
+size_t VertexStore::countInBox(const Box& box) const
+{
+    const size_t n = size();
+    const float* __restrict x = xs.data();
+    const float* __restrict y = ys.data();
+    const float* __restrict z = zs.data();
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += static_cast<size_t>((x[i] >= box.min.x) & (x[i] <= box.max.x) & (y[i] >= box.min.y) & (y[i] <= box.max.y) & (z[i] >= box.min.z) & (z[i] <= box.max.z));
+    }
+    return count;
+}
+
+void VertexStore::classify(Axis axis, float coordinate, float tolerance, std::vector<int8_t>& out) const
+{
+    const size_t n = size();
+    out.resize(n);
+    const float* __restrict c = coords(axis);
+    int8_t* __restrict res = out.data();
+    for (size_t i = 0; i < n; i++) {
+        const float d = c[i] - coordinate;
+        res[i] = static_cast<int8_t>((d >= tolerance) - (d <= -tolerance));
+    }
+}
+
+std::vector<float> VertexStore::interleaved() const
+{
+    const size_t n = size();
+    std::vector<float> out(3 * n);
+    for (size_t i = 0; i < n; i++) {
+        out[3 * i] = xs[i];
+        out[3 * i + 1] = ys[i];
+        out[3 * i + 2] = zs[i];
+    }
+    return out;
+}
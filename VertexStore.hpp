@@ -0,0 +1,129 @@
+#ifndef _VERTEXSTORE_HPP
+#define _VERTEXSTORE_HPP
+#include "Types.hpp"
+#include <cassert>
+#include <vector>
+#include <new>
+#include <iterator>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+* Allocator returning memory aligned to Alignment bytes, so the coordinate arrays can be loaded with aligned vector loads
+*/
+template<typename T, size_t Alignment = 32>
+struct AlignedAllocator
+{
+    typedef T value_type;
+    template<typename U>
+    struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+class VertexStoreIterator;
+
+/*  VertexStore class, stores the vertex coordinates as a structure of arrays
+*   Every coordinate lives in its own aligned array, so passes over all vertices only load the coordinates they need
+*   and can be vectorized by the compiler. Single vertices are read as a Vertex value and written via set.
+*/
+class VertexStore
+{
+public:
+    typedef std::vector<float, AlignedAllocator<float>> CoordinateArray;
+private:
+    CoordinateArray xs, ys, zs;
+public:
+    VertexStore() = default;
+    size_t size() const { return xs.size(); }
+    bool empty() const { return xs.empty(); }
+    void reserve(size_t n) { xs.reserve(n); ys.reserve(n); zs.reserve(n); }
+    size_t capacity() const { return xs.capacity(); }
+    void resize(size_t n, const Vertex& v = { 0.0f, 0.0f, 0.0f }) { xs.resize(n, v.x); ys.resize(n, v.y); zs.resize(n, v.z); }
+    void clear() { xs.clear(); ys.clear(); zs.clear(); }
+    void push_back(const Vertex& v) { xs.push_back(v.x); ys.push_back(v.y); zs.push_back(v.z); }
+    // Replace all vertices by n vertices with the given coordinate arrays
+    void assign(const float* x, const float* y, const float* z, size_t n) { xs.assign(x, x + n); ys.assign(y, y + n); zs.assign(z, z + n); }
+    void emplace_back(const Vertex& v) { push_back(v); }
+    Vertex operator[](size_t i) const { return { xs[i], ys[i], zs[i] }; }
+    void set(size_t i, const Vertex& v) { xs[i] = v.x; ys[i] = v.y; zs[i] = v.z; }
+    float x(size_t i) const { return xs[i]; }
+    float y(size_t i) const { return ys[i]; }
+    float z(size_t i) const { return zs[i]; }
+    // Coordinate of vertex i along axis
+    float coord(size_t i, Axis axis) const { return coords(axis)[i]; }
+    // The whole coordinate array along an axis
+    const float* coords(Axis axis) const {
+        switch (axis)
+        {
+        case Axis::x: return xs.data();
+        case Axis::y: return ys.data();
+        default: return zs.data();
+        }
+    }
+    VertexStoreIterator begin() const;
+    VertexStoreIterator end() const;
+
+    // Bulk geometry passes, written as plain loops over the coordinate arrays so they vectorize
+
+    // Smallest box containing all vertices
+    Box boundingBox() const;
+    // Number of vertices inside the closed box
+    size_t countInBox(const Box& box) const;
+    // For every vertex, -1 if it lies below the plane at coordinate along axis, 0 if within tolerance of it, 1 if above
+    void classify(Axis axis, float coordinate, float tolerance, std::vector<int8_t>& out) const;
+    // Copy the coordinates to an interleaved x,y,z array, for writing files
+    std::vector<float> interleaved() const;
+};
+
+/*
+* Random access iterator over a VertexStore, dereferences to a Vertex value
+*/
+class VertexStoreIterator
+{
+private:
+    const VertexStore* store = nullptr;
+    size_t index = 0;
+    size_t offset(std::ptrdiff_t n) const { return static_cast<size_t>(static_cast<std::ptrdiff_t>(index) + n); }
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef Vertex value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Vertex* pointer;
+    typedef Vertex reference;
+    VertexStoreIterator() = default;
+    VertexStoreIterator(const VertexStore* vertex_store, size_t vertex_index) : store(vertex_store), index(vertex_index) {}
+    Vertex operator*() const { return (*store)[index]; }
+    Vertex operator[](difference_type n) const { return (*store)[offset(n)]; }
+    VertexStoreIterator& operator++() { ++index; return *this; }
+    VertexStoreIterator operator++(int) { auto tmp = *this; ++index; return tmp; }
+    VertexStoreIterator& operator--() { --index; return *this; }
+    VertexStoreIterator operator--(int) { auto tmp = *this; --index; return tmp; }
+    VertexStoreIterator& operator+=(difference_type n) { index = offset(n); return *this; }
+    VertexStoreIterator& operator-=(difference_type n) { index = offset(-n); return *this; }
+    VertexStoreIterator operator+(difference_type n) const { return { store, offset(n) }; }
+    friend VertexStoreIterator operator+(difference_type n, const VertexStoreIterator& it) { return it + n; }
+    VertexStoreIterator operator-(difference_type n) const { return { store, offset(-n) }; }
+    difference_type operator-(const VertexStoreIterator& other) const { return static_cast<difference_type>(index) - static_cast<difference_type>(other.index); }
+    bool operator==(const VertexStoreIterator& other) const { return index == other.index; }
+    bool operator!=(const VertexStoreIterator& other) const { return index != other.index; }
+    bool operator<(const VertexStoreIterator& other) const { return index < other.index; }
+    bool operator>(const VertexStoreIterator& other) const { return index > other.index; }
+    bool operator<=(const VertexStoreIterator& other) const { return index <= other.index; }
+    bool operator>=(const VertexStoreIterator& other) const { return index >= other.index; }
+};
+
+inline VertexStoreIterator VertexStore::begin() const { return { this, 0 }; }
+inline VertexStoreIterator VertexStore::end() const { return { this, size() }; }
+#endif
@@ -1,9 +1,13 @@
 #include <catch2/catch.hpp>
+#include <set>
+#include <atomic>
 #include "../SubFaceTree.hpp"
 #include "../Mesh.hpp"
 #include "../Types.hpp"
 #include "../QuantitiesOfInterest.hpp"
 #include "../SplineMesh.hpp"
+#include "../MeshSnapshot.hpp"
+#include "../AdaptiveRefinement.hpp"
 
 namespace SanityChecks {
 	/*
@@ -34,6 +38,20 @@ namespace SanityChecks {
 		}
 		return true;
 	}
+
+	/*
+	* Check that every vertex is a corner of the cuboid V2lV points to and that the point locator finds every cuboid
+	*/
+	bool ConsistentIds(const Mesh& mesh) {
+		for (size_t v = 0; v < mesh.getVertices().size(); ++v) {
+			const auto lv = mesh.getV2lV()[v];
+			if (lv.getCuboid() >= mesh.getCuboids().size() || mesh.getCuboids()[lv.getCuboid()].vertices[lv.getLocalId()] != v) return false;
+		}
+		for (size_t cub = 0; cub < mesh.getCuboids().size(); ++cub) {
+			if (mesh.Locate(mesh.getBoxes()[cub].center()) != cub) return false;
+		}
+		return true;
+	}
 }
 
 namespace helpers {
@@ -66,6 +84,51 @@ namespace helpers {
 		}
 		return mesh;
 	}
+
+	/*
+	* Check that two meshes have exactly the same structure
+	*/
+	bool same_mesh(const Mesh& a, const Mesh& b) {
+		if (a.getVertices().size() != b.getVertices().size() || a.getCuboids().size() != b.getCuboids().size()) return false;
+		if (a.getF2f() != b.getF2f() || a.getV2lV() != b.getV2lV()) return false;
+		for (size_t v = 0; v < a.getVertices().size(); ++v) {
+			if (!(a.getVertices()[v] == b.getVertices()[v])) return false;
+		}
+		for (size_t c = 0; c < a.getCuboids().size(); ++c) {
+			if (a.getCuboids()[c].vertices != b.getCuboids()[c].vertices) return false;
+		}
+		const auto& a_nodes = a.getSft().nodes;
+		const auto& b_nodes = b.getSft().nodes;
+		if (a_nodes.size() != b_nodes.size()) return false;
+		for (size_t n = 0; n < a_nodes.size(); ++n) {
+			if (!(a_nodes[n].parent == b_nodes[n].parent) || a_nodes[n].getSplitCoord() != b_nodes[n].getSplitCoord() || a_nodes[n].getSplitAxis() != b_nodes[n].getSplitAxis()
+				|| !(a_nodes[n].lower_child == b_nodes[n].lower_child) || !(a_nodes[n].top_child == b_nodes[n].top_child)) return false;
+		}
+		return true;
+	}
+
+	/*
+	* Generate random split requests by applying them to the given mesh, with a fixed seed so the sequence is reproducible
+	*/
+	std::vector<SplitRequest> random_splits(Mesh& mesh, const int num, const unsigned seed) {
+		std::mt19937 random_engine(seed);
+		std::uniform_real_distribution<float> fl_distr(0.2, 0.8);
+		std::vector<SplitRequest> requests;
+		for (int i = 0; i < num; ++i) {
+			std::uniform_int_distribution<uint32_t> distribution(0, mesh.getCuboids().size() - 1);
+			const uint32_t elem = distribution(random_engine);
+			const auto bl_corner = mesh.getVertices()[mesh.getCuboids()[elem].v1];
+			const auto tr_corner = mesh.getVertices()[mesh.getCuboids()[elem].v7];
+			const auto rand = fl_distr(random_engine);
+			const auto frac = fl_distr(random_engine);
+			SplitRequest request{ elem, Axis::x, frac * (tr_corner.x - bl_corner.x) + bl_corner.x };
+			if (rand < 0.4) request = { elem, Axis::z, frac * (tr_corner.z - bl_corner.z) + bl_corner.z };
+			else if (rand < 0.6) request = { elem, Axis::y, frac * (tr_corner.y - bl_corner.y) + bl_corner.y };
+			mesh.SplitAlongAxis(request.cuboid, request.coordinate, request.axis);
+			requests.push_back(request);
+		}
+		return requests;
+	}
 } // helpers
 
 
@@ -603,3 +666,1186 @@ TEST_CASE("Spline degree for cartesian mesh is correct") {
 	auto kernel = Q.block(0, QR.rank(), Q.rows(), Q.cols() - QR.rank());
 	CHECK(kernel.cols() == (N_x*N_y*N_z));
 }
+
+TEST_CASE("Parallel splits give the same mesh as splitting in colour order", "[Mesh]")
+{
+	Mesh sequential(4, 4, 4), parallel(4, 4, 4), single(4, 4, 4);
+	helpers::random_splits(sequential, 200, 7);
+	helpers::random_splits(parallel, 200, 7);
+	helpers::random_splits(single, 200, 7);
+	std::vector<SplitRequest> requests;
+	for (uint32_t i = 0; i < sequential.getCuboids().size(); i++) {
+		const auto bl_corner = sequential.getVertices()[sequential.getCuboids()[i].v1];
+		const auto tr_corner = sequential.getVertices()[sequential.getCuboids()[i].v7];
+		const auto middle = (bl_corner + tr_corner) / 2;
+		if (i % 3 == 0) requests.push_back({ i, Axis::x, middle.x });
+		else if (i % 3 == 1) requests.push_back({ i, Axis::y, middle.y });
+		else requests.push_back({ i, Axis::z, middle.z });
+	}
+	// Split the first cuboid twice, the second split has to wait for the first
+	requests.push_back({ 0, Axis::z, (sequential.getVertices()[sequential.getCuboids()[0].v1].z + sequential.getVertices()[sequential.getCuboids()[0].v7].z) / 2 });
+	const auto colours = sequential.ColourSplits(requests);
+	CHECK(colours.back() > colours.front());
+	std::vector<uint32_t> order(requests.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return colours[a] < colours[b]; });
+	for (const auto i : order) sequential.SplitAlongAxis(requests[i].cuboid, requests[i].coordinate, requests[i].axis);
+
+	const auto new_ids = parallel.SplitParallel(requests, 4);
+	single.SplitParallel(requests, 1);
+	CHECK(std::find(new_ids.begin(), new_ids.end(), static_cast<uint32_t>(-1)) == new_ids.end());
+	CHECK(helpers::same_mesh(sequential, parallel));
+	CHECK(helpers::same_mesh(single, parallel));
+	CHECK(SanityChecks::AllAdjacent(parallel));
+}
+
+TEST_CASE("Vertex store bulk passes, iterators and interleaved copies agree with the vertices", "[VertexStore]")
+{
+	Mesh mesh(3, 3, 3);
+	helpers::random_splits(mesh, 300, 3);
+	const auto& vertices = mesh.getVertices();
+	const auto box = vertices.boundingBox();
+	CHECK(box.min == Vertex{ 0.0, 0.0, 0.0 });
+	CHECK(box.max == Vertex{ 1.0, 1.0, 1.0 });
+	CHECK(vertices.countInBox(box) == vertices.size());
+	const Box lower{ { 0.0, 0.0, 0.0 }, { 1.0, 0.5, 1.0 } };
+	CHECK(vertices.countInBox(lower) == static_cast<size_t>(std::count_if(vertices.begin(), vertices.end(), [](const Vertex& v) { return v.y <= 0.5f; })));
+	const Vertex middle = vertices[mesh.getCuboids()[100].v7];
+	std::vector<int8_t> sides;
+	vertices.classify(Axis::y, middle.y, eps, sides);
+	REQUIRE(sides.size() == vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		const int8_t expected = floatSame(vertices[v].y, middle.y) ? 0 : (vertices[v].y < middle.y ? -1 : 1);
+		CHECK(sides[v] == expected);
+	}
+	const auto found = std::find(vertices.begin(), vertices.end(), middle);
+	CHECK(found - vertices.begin() <= static_cast<std::ptrdiff_t>(mesh.getCuboids()[100].v7));
+	CHECK(*found == middle);
+	CHECK((vertices.end() - 1)[-4] == vertices[vertices.size() - 5]);
+	CHECK(*(vertices.begin() + 7) == vertices[7]);
+	const auto interleaved = vertices.interleaved();
+	CHECK(interleaved[3 * 5 + 2] == vertices.z(5));
+}
+
+TEST_CASE("Split points are snapped to the lattice", "[Mesh]")
+{
+	Mesh mesh(Lattice{ 4 });
+	const auto new_id = mesh.SplitAlongAxis(0, 0.3, Axis::x);
+	REQUIRE(new_id == 1);
+	CHECK(mesh.getVertices().x(mesh.getCuboids()[1].v1) == 0.3125f);
+	CHECK(mesh.getLattice().toLattice(mesh.getVertices().x(mesh.getCuboids()[1].v1)) == 5);
+	// Snaps onto the border of the cuboid, so no split happens
+	CHECK(mesh.SplitAlongAxis(0, 0.01, Axis::y) == static_cast<uint32_t>(-1));
+	CHECK_THROWS(Mesh(Lattice{ 25 }));
+}
+
+TEST_CASE("Deep refinement on the lattice keeps vertices unique", "[Mesh]")
+{
+	Mesh mesh(Lattice{ Lattice::max_levels });
+	for (int level = 1; level < Lattice::max_levels; level++) {
+		const float h = std::ldexp(1.0f, -level);
+		// Cuboid 0 keeps the corner at the origin, its neighbour in x is split at the same height
+		const auto right = mesh.SplitAlongAxis(0, h, Axis::x);
+		REQUIRE(right != static_cast<uint32_t>(-1));
+		REQUIRE(mesh.SplitAlongAxis(0, h, Axis::z) != static_cast<uint32_t>(-1));
+		const auto vertices_before = mesh.getVertices().size();
+		REQUIRE(mesh.SplitAlongAxis(right, h, Axis::z) != static_cast<uint32_t>(-1));
+		// Only the vertices on the far side of the right cuboid are new
+		CHECK(mesh.getVertices().size() == vertices_before + 2);
+		REQUIRE(mesh.SplitAlongAxis(0, h, Axis::y) != static_cast<uint32_t>(-1));
+	}
+	const auto& lattice = mesh.getLattice();
+	std::set<std::array<uint32_t, 3>> lattice_points;
+	for (const auto v : mesh.getVertices()) {
+		lattice_points.insert({ lattice.toLattice(v.x), lattice.toLattice(v.y), lattice.toLattice(v.z) });
+	}
+	CHECK(lattice_points.size() == mesh.getVertices().size());
+	CHECK(SanityChecks::AllAdjacent(mesh));
+}
+
+TEST_CASE("Locate the cuboid containing a point", "[Mesh]")
+{
+	Mesh mesh(3, 3, 3);
+	helpers::random_splits(mesh, 500, 11);
+	std::vector<Vertex> centres;
+	for (const auto& cuboid : mesh.getCuboids()) {
+		centres.push_back((mesh.getVertices()[cuboid.v1] + mesh.getVertices()[cuboid.v7]) / 2);
+	}
+	bool all_found = true;
+	for (uint32_t i = 0; i < centres.size(); i++) all_found &= mesh.Locate(centres[i]) == i;
+	CHECK(all_found);
+	CHECK(mesh.Locate({ 1.5, 0.5, 0.5 }) == static_cast<uint32_t>(-1));
+	CHECK(mesh.Locate({ 0.5, -0.1, 0.5 }) == static_cast<uint32_t>(-1));
+	// The corners of the domain are inside
+	CHECK(mesh.Locate({ 0.0, 0.0, 0.0 }) != static_cast<uint32_t>(-1));
+	CHECK(mesh.Locate({ 1.0, 1.0, 1.0 }) != static_cast<uint32_t>(-1));
+
+	std::vector<uint32_t> batched(centres.size());
+	mesh.Locate(centres, batched, 4);
+	std::vector<uint32_t> expected(centres.size());
+	std::iota(expected.begin(), expected.end(), 0);
+	CHECK(batched == expected);
+
+	const auto depth = mesh.getLocator().depth();
+	mesh.RebuildLocator();
+	CHECK(mesh.getLocator().depth() <= depth);
+	mesh.Locate(centres, batched, 4);
+	CHECK(batched == expected);
+}
+
+TEST_CASE("Point locator falls back to a bucket without a guillotine cut", "[PointLocator]")
+{
+	// Five boxes forming a pinwheel, no plane separates them
+	const float t = 1.0f / 3.0f, s = 2.0f / 3.0f;
+	const std::vector<Box> boxes = { {{0, 0, 0}, {s, t, 1}}, {{s, 0, 0}, {1, s, 1}}, {{t, s, 0}, {1, 1, 1}}, {{0, t, 0}, {t, 1, 1}}, {{t, t, 0}, {s, s, 1}} };
+	PointLocator locator;
+	locator.build(boxes);
+	CHECK(locator.getNodes().size() == 1);
+	const auto contains = [&](uint32_t box, const Vertex& p) { return boxes[box].contains(p); };
+	for (uint32_t i = 0; i < boxes.size(); i++) {
+		CHECK(locator.locate(boxes[i].center(), contains) == i);
+	}
+	// Splitting a box in the bucket keeps both halves in it
+	locator.split(4, Axis::x, 0.5f, 5);
+	CHECK(locator.getNodes().size() == 1);
+}
+
+TEST_CASE("Cached bounding boxes follow the splits", "[Mesh]")
+{
+	Mesh mesh(2, 2, 2);
+	helpers::random_splits(mesh, 300, 5);
+	std::vector<SplitRequest> requests;
+	for (uint32_t i = 0; i < mesh.getCuboids().size(); i += 2) requests.push_back({ i, Axis::y, mesh.getBoxes()[i].center().y });
+	mesh.SplitParallel(requests, 4);
+	REQUIRE(mesh.getBoxes().size() == mesh.getCuboids().size());
+	bool all_match = true;
+	for (size_t i = 0; i < mesh.getCuboids().size(); i++) {
+		all_match &= mesh.getBoxes()[i].min == mesh.getVertices()[mesh.getCuboids()[i].v1];
+		all_match &= mesh.getBoxes()[i].max == mesh.getVertices()[mesh.getCuboids()[i].v7];
+	}
+	CHECK(all_match);
+}
+
+TEST_CASE("A snapshot loads back to the same mesh", "[MeshSnapshot]")
+{
+	Mesh mesh(2, 3, 2, Lattice{ 20 });
+	helpers::random_splits(mesh, 400, 21);
+	mesh.SaveSnapshot("snapshot_test.bin");
+	Mesh loaded;
+	loaded.LoadSnapshot("snapshot_test.bin");
+	CHECK(helpers::same_mesh(mesh, loaded));
+	CHECK(loaded.getLattice().levels == 20);
+	CHECK(loaded.getSft().getFreeList() == mesh.getSft().getFreeList());
+
+	MeshView view("snapshot_test.bin");
+	REQUIRE(view.getCuboids().size() == mesh.getCuboids().size());
+	CHECK(view.vertex(7) == mesh.getVertices()[7]);
+	// Iterating the subface trees through the view gives the same faces
+	bool same_faces = true;
+	for (uint32_t hf = 0; hf < view.getF2f().size(); hf++) {
+		const auto twin = view.getF2f()[hf];
+		if (!twin.isSubdivided()) continue;
+		std::vector<halfFace> from_view, from_mesh;
+		for (auto it = view.getSft().cbegin(twin); it != view.getSft().cend(); ++it) from_view.push_back(*it);
+		for (auto it = mesh.getSft().cbegin(twin); it != mesh.getSft().cend(); ++it) from_mesh.push_back(*it);
+		same_faces &= from_view == from_mesh;
+	}
+	CHECK(same_faces);
+	std::remove("snapshot_test.bin");
+
+	// Splitting continues the same way, including reuse of free subface nodes
+	helpers::random_splits(mesh, 100, 22);
+	helpers::random_splits(loaded, 100, 22);
+	CHECK(helpers::same_mesh(mesh, loaded));
+	CHECK(loaded.Locate(loaded.getBoxes()[42].center()) == 42);
+}
+
+TEST_CASE("Loading an invalid snapshot throws", "[MeshSnapshot]")
+{
+	std::ofstream("not_a_snapshot.bin") << "ply\nformat ascii 1.0\n";
+	Mesh mesh;
+	CHECK_THROWS_AS(mesh.LoadSnapshot("not_a_snapshot.bin"), std::runtime_error);
+	CHECK_THROWS_AS(MeshView("not_a_snapshot.bin"), std::runtime_error);
+	CHECK_THROWS_AS(mesh.LoadSnapshot("does_not_exist.bin"), std::runtime_error);
+	std::remove("not_a_snapshot.bin");
+	// A section offset so large that offset + size wraps around
+	mesh.SaveSnapshot("corrupt_snapshot.bin");
+	{
+		std::fstream file("corrupt_snapshot.bin", std::ios::in | std::ios::out | std::ios::binary);
+		const uint64_t offset = ~uint64_t{ 63 };
+		file.seekp(offsetof(SnapshotHeader, offsets));
+		file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+	}
+	CHECK_THROWS_AS(mesh.LoadSnapshot("corrupt_snapshot.bin"), std::runtime_error);
+	CHECK_THROWS_AS(MeshView("corrupt_snapshot.bin"), std::runtime_error);
+	std::remove("corrupt_snapshot.bin");
+}
+
+TEST_CASE("A saved binary mesh loads back with the same cuboids", "[Mesh]")
+{
+	Mesh mesh(3, 2, 2);
+	helpers::random_splits(mesh, 300, 17);
+	mesh.Save("binary_roundtrip", true, true);
+	Mesh loaded;
+	loaded.Load("binary_roundtrip");
+	REQUIRE(loaded.getCuboids().size() == mesh.getCuboids().size());
+	auto sorted_boxes = [](const Mesh& m) {
+		std::vector<std::array<float, 6>> boxes;
+		for (const auto& box : m.getBoxes()) boxes.push_back({ box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z });
+		std::sort(boxes.begin(), boxes.end());
+		return boxes;
+	};
+	CHECK(sorted_boxes(loaded) == sorted_boxes(mesh));
+	CHECK(SanityChecks::AllAdjacent(loaded));
+	// The header carries the bounding box of the vertices
+	std::ifstream header("binary_roundtrip.ply", std::ios::binary);
+	std::vector<std::string> header_lines;
+	for (std::string line; std::getline(header, line) && line != "end_header";) header_lines.push_back(line);
+	CHECK(std::find(header_lines.begin(), header_lines.end(), "comment bounding box 0 0 0 1 1 1") != header_lines.end());
+	header.close();
+	std::remove("binary_roundtrip.ply");
+}
+
+TEST_CASE("Shared faces are written once", "[Mesh]")
+{
+	Mesh mesh(2, 2, 2);
+	mesh.SplitAlongAxis(0, 0.25, Axis::x);
+	mesh.Save("unique_faces", false, true);
+	std::ifstream in("unique_faces.ply");
+	std::string line;
+	while (std::getline(in, line) && line.rfind("element face", 0) != 0);
+	// 24 border faces and 12 interior faces, the split adds two border faces and the face between the halves.
+	// The split side faces towards the neighbours are written once by the undivided neighbour faces
+	CHECK(line == "element face 39");
+	in.close();
+	std::remove("unique_faces.ply");
+}
+
+TEST_CASE("Load a mesh given by faces only", "[Mesh]")
+{
+	std::ofstream out("faces_only.ply");
+	out << "ply\nformat ascii 1.0\nelement vertex 12\nproperty float x\nproperty float y\nproperty float z\n"
+		<< "element face 12\nproperty list uchar int vertex_index\nend_header\n"
+		<< "0 0 0\n0.5 0 0\n0.5 1 0\n0 1 0\n0 0 1\n0.5 0 1\n0.5 1 1\n0 1 1\n1 0 0\n1 1 0\n1 0 1\n1 1 1\n";
+	const std::array<std::array<int, 8>, 2> cubes = { { {0, 1, 2, 3, 4, 5, 6, 7}, {1, 8, 9, 2, 5, 10, 11, 6} } };
+	for (const auto& cube : cubes) {
+		for (const auto& face : Hf2Ve) {
+			out << "4 " << cube[face[0]] << ' ' << cube[face[1]] << ' ' << cube[face[2]] << ' ' << cube[face[3]] << '\n';
+		}
+	}
+	out.close();
+	Mesh mesh;
+	mesh.Load("faces_only.ply");
+	REQUIRE(mesh.getCuboids().size() == 2);
+	CHECK(mesh.getVertices().size() == 12);
+	CHECK(mesh.getBoxes()[1].min == Vertex{ 0.5, 0.0, 0.0 });
+	std::remove("faces_only.ply");
+
+	out.open("outside.ply");
+	out << "ply\nformat ascii 1.0\nelement vertex 2\nproperty float x\nproperty float y\nproperty float z\n"
+		<< "element cuboid 1\nproperty list uchar uint vertex_indices\nend_header\n0 0 0\n2 1 1\n8 0 1 1 1 1 1 1 1\n";
+	out.close();
+	CHECK_THROWS_AS(mesh.Load("outside.ply"), std::runtime_error);
+	std::remove("outside.ply");
+}
+
+TEST_CASE("Split a cuboid into slabs at several planes at once", "[Mesh]")
+{
+	Mesh mesh(2, 2, 2);
+	const std::vector<float> planes{ 0.4, 0.1, 0.3, 0.7 };
+	const auto slabs = mesh.SplitAlongAxisMulti(0, Axis::x, planes);
+	// 0.7 lies outside the first cuboid
+	REQUIRE(slabs.size() == 4);
+	CHECK(slabs[0] == 0);
+	CHECK(mesh.getVertices()[mesh.getCuboids()[slabs[1]].v1].x == Approx(0.1));
+	CHECK(mesh.getVertices()[mesh.getCuboids()[slabs[3]].v1].x == Approx(0.4));
+	CHECK(mesh.getCuboids().size() == 11);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+}
+
+TEST_CASE("Subdivide a cuboid into eighths in one call", "[Mesh]")
+{
+	Mesh mesh;
+	const auto children = mesh.Subdivide(0, 2, 2, 2);
+	REQUIRE(children.size() == 8);
+	CHECK(mesh.getCuboids().size() == 8);
+	CHECK(mesh.getVertices().size() == 27);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+	// Child (1, 1, 1) is the top right corner
+	const auto& top = mesh.getCuboids()[children[7]];
+	CHECK(mesh.getVertices()[top.v1] == Vertex{ 0.5, 0.5, 0.5 });
+	CHECK(mesh.getVertices()[top.v7] == Vertex{ 1.0, 1.0, 1.0 });
+	QuantitiesOfInterest q(mesh);
+	CHECK(q.vertexConnectivity(mesh.getCuboids()[children[0]].v7).number == 8);
+	// Subdividing a cuboid next to a coarser neighbour keeps the mesh consistent
+	const auto grandchildren = mesh.Subdivide(children[3], 3, 1, 2);
+	CHECK(grandchildren.size() == 6);
+	CHECK(mesh.getCuboids().size() == 13);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+
+	SECTION("Planes that coincide on the lattice are rejected") {
+		// Thirds of the unit cube snap to 0.25 and 0.75 on a lattice of 2 levels, fifths snap onto each other
+		Mesh lattice_mesh(Lattice{ 2 });
+		CHECK(lattice_mesh.Subdivide(0, 5, 1, 1).empty());
+		CHECK(lattice_mesh.getCuboids().size() == 1);
+		const auto thirds = lattice_mesh.Subdivide(0, 3, 1, 1);
+		REQUIRE(thirds.size() == 3);
+		CHECK(lattice_mesh.getBoxes()[thirds[1]].min.x == 0.25f);
+		CHECK(lattice_mesh.getBoxes()[thirds[2]].min.x == 0.75f);
+	}
+}
+
+TEST_CASE("Subdividing gives the same mesh as the sequential splits", "[Mesh]")
+{
+	for (const bool vertex_hash : { false, true }) {
+		Mesh sequential(3, 3, 3), subdivided(3, 3, 3);
+		sequential.EnableVertexHash(vertex_hash);
+		subdivided.EnableVertexHash(vertex_hash);
+		helpers::random_splits(sequential, 300, 61);
+		helpers::random_splits(subdivided, 300, 61);
+		// Every fourth cuboid into 2 x 3 x 2 children, so neighbours are finer, coarser or subdivided before
+		for (uint32_t cub = 0; cub < 320; cub += 4) {
+			const Box box = sequential.getBoxes()[cub];
+			const Vertex size = box.max - box.min;
+			std::vector<uint32_t> slabs{ cub }, rows;
+			slabs.push_back(sequential.SplitAlongXY(cub, box.min.z + size.z / 2));
+			for (const uint32_t slab : slabs) {
+				rows.assign(1, slab);
+				for (const float y : { box.min.y + size.y / 3, box.min.y + size.y * 2 / 3 }) rows.push_back(sequential.SplitAlongXZ(rows.back(), y));
+				for (const uint32_t row : rows) sequential.SplitAlongYZ(row, box.min.x + size.x / 2);
+			}
+			REQUIRE(subdivided.Subdivide(cub, 2, 3, 2).size() == 12);
+		}
+		CHECK(helpers::same_mesh(sequential, subdivided));
+		CHECK(SanityChecks::AllAdjacent(subdivided));
+	}
+}
+
+TEST_CASE("Merging split cuboids restores the mesh", "[Mesh]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 300, 11);
+	const size_t num_cuboids = mesh.getCuboids().size();
+	const size_t num_vertices = mesh.getVertices().size();
+	for (uint32_t cub = 0; cub < num_cuboids; cub += 7) {
+		const Box box = mesh.getBoxes()[cub];
+		const uint32_t top = mesh.SplitAlongAxis(cub, 0.5f * (box.min.y + box.max.y), Axis::y);
+		REQUIRE(top != static_cast<uint32_t>(-1));
+		CHECK(mesh.Merge(top, cub).cuboid == cub);
+		CHECK(mesh.getBoxes()[cub].min == box.min);
+		CHECK(mesh.getBoxes()[cub].max == box.max);
+	}
+	CHECK(mesh.getCuboids().size() == num_cuboids);
+	CHECK(mesh.getVertices().size() == num_vertices);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+	CHECK(SanityChecks::ConsistentIds(mesh));
+}
+
+TEST_CASE("Merge a subdivided cube back into one cuboid", "[Mesh]")
+{
+	Mesh mesh;
+	mesh.Subdivide(0, 2, 2, 2);
+	// Merge in a different order than the splits, the ids are compacted after every merge
+	while (mesh.getCuboids().size() > 1) {
+		const uint32_t last = mesh.getCuboids().size() - 1;
+		uint32_t merged = static_cast<uint32_t>(-1);
+		for (uint32_t a = last; a > 0 && merged == static_cast<uint32_t>(-1); --a) {
+			for (uint32_t b = 0; b < a && merged == static_cast<uint32_t>(-1); ++b) merged = mesh.Merge(a, b).cuboid;
+		}
+		REQUIRE(merged != static_cast<uint32_t>(-1));
+		CHECK(SanityChecks::AllAdjacent(mesh));
+		CHECK(SanityChecks::ConsistentIds(mesh));
+	}
+	CHECK(mesh.getVertices().size() == 8);
+	for (uint8_t i = 0; i < 6; i++) {
+		CHECK(mesh.Twin(halfFace(0, i)).isBorder());
+	}
+	// The freed subface nodes are reused
+	const size_t num_nodes = mesh.getSft().nodes.size();
+	mesh.Subdivide(0, 2, 2, 2);
+	CHECK(mesh.getSft().nodes.size() == num_nodes);
+}
+
+TEST_CASE("Only cuboids sharing a complete face can be merged", "[Mesh]")
+{
+	Mesh mesh;
+	const uint32_t right = mesh.SplitAlongYZ(0, 0.5);
+	const uint32_t top_left = mesh.SplitAlongXY(0, 0.5);
+	// Not adjacent at all
+	CHECK(!mesh.Merge(0, 0).merged());
+	// Shares only half of its face
+	CHECK(!mesh.Merge(top_left, right).merged());
+	const uint32_t top_right = mesh.SplitAlongXY(right, 0.5);
+	const uint32_t front = mesh.SplitAlongXZ(top_right, 0.5);
+	// Full faces, but the merged cuboid would cover half of the face of front
+	CHECK(!mesh.Merge(right, top_right).merged());
+	CHECK(mesh.Merge(top_right, front).cuboid == top_right);
+	CHECK(mesh.Merge(right, top_right).cuboid == right);
+	CHECK(mesh.getCuboids().size() == 3);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+	CHECK(SanityChecks::ConsistentIds(mesh));
+}
+
+TEST_CASE("Random merges keep the mesh consistent", "[Mesh]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 400, 5);
+	std::mt19937 random_engine(5);
+	size_t merges = 0;
+	for (int i = 0; i < 2000 && mesh.getCuboids().size() > 1; ++i) {
+		std::uniform_int_distribution<uint32_t> distribution(0, mesh.getCuboids().size() - 1);
+		const uint32_t cub = distribution(random_engine);
+		for (uint8_t face = 0; face < 6; face++) {
+			const auto twin = mesh.Twin(halfFace(cub, face));
+			if (twin.isBorder() || twin.isSubdivided()) continue;
+			if (mesh.Merge(cub, twin.getCuboid()).merged()) {
+				merges++;
+				break;
+			}
+		}
+	}
+	CHECK(merges > 100);
+	CHECK(mesh.getCuboids().size() == 401 - merges);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+	CHECK(SanityChecks::ConsistentIds(mesh));
+	// The merged mesh can be refined again
+	helpers::random_splits(mesh, 100, 6);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+	CHECK(SanityChecks::ConsistentIds(mesh));
+}
+
+TEST_CASE("Merge reports how it renumbered the cuboids and vertices", "[Mesh]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 300, 12);
+	// Data stored outside the mesh, renumbered with the moves reported by every merge
+	std::vector<Box> cuboid_data = mesh.getBoxes();
+	std::vector<Vertex> vertex_data(mesh.getVertices().begin(), mesh.getVertices().end());
+	const auto apply = [](auto& data, const RemovedId& id) {
+		data[id.removed] = data[id.last];
+		data.pop_back();
+	};
+	size_t merges = 0, moved_vertices = 0;
+	for (uint32_t cub = 0; cub < mesh.getCuboids().size(); cub += 3) {
+		for (const uint8_t face : { 1, 2, 3 }) {
+			const auto twin = mesh.Twin(halfFace(cub, face));
+			if (twin.isBorder() || twin.isSubdivided()) continue;
+			const auto result = mesh.Merge(cub, twin.getCuboid());
+			if (!result.merged()) continue;
+			merges++;
+			cuboid_data[result.cuboid] = mesh.getBoxes()[result.cuboid];
+			apply(cuboid_data, result.removed_cuboid);
+			for (const auto& id : result.removed_vertices) {
+				moved_vertices += id.removed != id.last;
+				apply(vertex_data, id);
+			}
+			CHECK(result.cuboid == std::min(cub, twin.getCuboid()));
+			break;
+		}
+	}
+	CHECK(merges > 20);
+	CHECK(moved_vertices > 0);
+	REQUIRE(cuboid_data.size() == mesh.getCuboids().size());
+	REQUIRE(vertex_data.size() == mesh.getVertices().size());
+	bool same = true;
+	for (uint32_t c = 0; c < cuboid_data.size(); c++) same &= cuboid_data[c].min == mesh.getBoxes()[c].min && cuboid_data[c].max == mesh.getBoxes()[c].max;
+	for (uint32_t v = 0; v < vertex_data.size(); v++) same &= vertex_data[v] == mesh.getVertices()[v];
+	CHECK(same);
+	CHECK(!mesh.Merge(0, 0).merged());
+}
+
+TEST_CASE("The vertex hash finds the same vertices as the subface trees", "[VertexHash]")
+{
+	Mesh tree_mesh;
+	Mesh hash_mesh;
+	hash_mesh.EnableVertexHash();
+	std::mt19937 random_engine(3);
+	std::uniform_real_distribution<float> fl_distr(0.2, 0.8);
+	for (int i = 0; i < 2000; ++i) {
+		std::uniform_int_distribution<uint32_t> distribution(0, tree_mesh.getCuboids().size() - 1);
+		const uint32_t elem = distribution(random_engine);
+		const Box box = tree_mesh.getBoxes()[elem];
+		const float rand = fl_distr(random_engine);
+		const Axis axis = rand < 0.4 ? Axis::x : (rand < 0.6 ? Axis::y : Axis::z);
+		const float coordinate = axisCoord(box.min, axis) + fl_distr(random_engine) * (axisCoord(box.max, axis) - axisCoord(box.min, axis));
+		tree_mesh.SplitAlongAxis(elem, coordinate, axis);
+		hash_mesh.SplitAlongAxis(elem, coordinate, axis);
+	}
+	CHECK(helpers::same_mesh(tree_mesh, hash_mesh));
+}
+
+TEST_CASE("Meshes split with the vertex hash have no duplicate vertices", "[VertexHash]")
+{
+	for (const Lattice lattice : { Lattice{}, Lattice{ 20 } }) {
+		Mesh mesh(lattice);
+		mesh.EnableVertexHash();
+		const auto requests = helpers::random_splits(mesh, 1500, 8);
+		CHECK(SanityChecks::AllAdjacent(mesh));
+		std::set<std::array<float, 3>> positions;
+		for (const auto v : mesh.getVertices()) positions.insert({ v.x, v.y, v.z });
+		CHECK(positions.size() == mesh.getVertices().size());
+		// Merging removes the vertices from the hash again
+		for (uint32_t cub = 0; cub < 200; ++cub) {
+			const auto twin = mesh.Twin(halfFace(cub, 3));
+			if (!twin.isBorder() && !twin.isSubdivided()) mesh.Merge(cub, twin.getCuboid());
+		}
+		// Splitting in parallel gives the same mesh
+		Mesh parallel(lattice);
+		parallel.EnableVertexHash();
+		Mesh sequential(lattice);
+		sequential.EnableVertexHash();
+		for (const auto& request : std::span(requests).first(300)) {
+			parallel.SplitAlongAxis(request.cuboid, request.coordinate, request.axis);
+			sequential.SplitAlongAxis(request.cuboid, request.coordinate, request.axis);
+		}
+		std::vector<SplitRequest> centre_splits;
+		for (uint32_t i = 0; i < sequential.getCuboids().size(); i++) centre_splits.push_back({ i, static_cast<Axis>(i % 3), axisCoord(sequential.getBoxes()[i].center(), static_cast<Axis>(i % 3)) });
+		const auto colours = sequential.ColourSplits(centre_splits);
+		std::vector<uint32_t> order(centre_splits.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return colours[a] < colours[b]; });
+		for (const auto i : order) sequential.SplitAlongAxis(centre_splits[i].cuboid, centre_splits[i].coordinate, centre_splits[i].axis);
+		parallel.SplitParallel(centre_splits, 4);
+		CHECK(helpers::same_mesh(parallel, sequential));
+	}
+}
+
+TEST_CASE("Edge table of a uniform mesh", "[EdgeTable]")
+{
+	Mesh mesh(2, 2, 2);
+	const EdgeTable table(mesh);
+	// 3 directions with 2 * 3 * 3 edges each
+	REQUIRE(table.size() == 54);
+	const uint32_t centre = mesh.getCuboids()[0].v7;
+	const uint32_t e = table.find(centre, mesh.getCuboids()[0].v3);
+	REQUIRE(e != static_cast<uint32_t>(-1));
+	CHECK(table.cuboids(e).size() == 4);
+	CHECK(table.find(0, centre) == static_cast<uint32_t>(-1));
+	for (uint32_t i = 0; i < table.size(); i++) CHECK_FALSE(table.isTJunction(i));
+}
+
+TEST_CASE("Edges with a hanging vertex are T-junctions", "[EdgeTable]")
+{
+	Mesh mesh(2, 1, 1);
+	mesh.SplitAlongXY(0, 0.5);
+	const EdgeTable table(mesh);
+	size_t t_junctions = 0;
+	for (uint32_t e = 0; e < table.size(); e++) {
+		if (!table.isTJunction(e)) continue;
+		t_junctions++;
+		// Only the edges of the unsplit cuboid along z at x = 0.5 have the new vertices inside them
+		CHECK(table.cuboids(e).size() == 1);
+		CHECK(table.cuboids(e)[0] == 1);
+	}
+	CHECK(t_junctions == 2);
+}
+
+TEST_CASE("The edge table has the same edges as the cuboids", "[EdgeTable]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 2000, 12);
+	const EdgeTable table(mesh, 4);
+	const EdgeTable single(mesh, 1);
+	QuantitiesOfInterest q(mesh);
+	std::set<std::pair<uint32_t, uint32_t>> expected;
+	size_t cuboid_edges = 0;
+	bool all_found = true;
+	for (uint32_t c = 0; c < mesh.getCuboids().size(); c++) {
+		for (const auto& edge : q.getEdges(c)) {
+			expected.insert({ std::min(edge.v1, edge.v2), std::max(edge.v1, edge.v2) });
+			const uint32_t e = table.find(edge.v1, edge.v2);
+			if (e == static_cast<uint32_t>(-1)) {
+				all_found = false;
+				continue;
+			}
+			const auto cuboids = table.cuboids(e);
+			all_found &= std::find(cuboids.begin(), cuboids.end(), c) != cuboids.end();
+			cuboid_edges++;
+		}
+	}
+	CHECK(all_found);
+	CHECK(table.size() == expected.size());
+	size_t total = 0;
+	bool same = true;
+	for (uint32_t e = 0; e < table.size(); e++) {
+		total += table.cuboids(e).size();
+		same &= table[e] == single[e] && std::equal(table.cuboids(e).begin(), table.cuboids(e).end(), single.cuboids(e).begin(), single.cuboids(e).end());
+	}
+	CHECK(total == cuboid_edges);
+	CHECK(same);
+	CHECK(q.getAllEdges().size() == expected.size());
+	CHECK(q.getEdgeTable().size() == expected.size());
+}
+
+TEST_CASE("The vertex star holds all cuboids touching a vertex", "[VertexStar]")
+{
+	Mesh mesh(2, 1, 1);
+	const uint32_t top = mesh.SplitAlongXY(0, 0.5);
+	// The new vertices at x = 0.5 hang on an edge of cuboid 1
+	const uint32_t hanging = mesh.getCuboids()[top].v2;
+	const auto star = mesh.getVertexStar().cuboids(hanging);
+	CHECK(std::vector<uint32_t>(star.begin(), star.end()) == std::vector<uint32_t>{ 0, 1, top });
+	QuantitiesOfInterest q(mesh);
+	CHECK_FALSE(q.ElementVertexIncidenceMatrix().coeff(hanging, 1));
+	CHECK(q.ElementVertexIncidenceMatrix(true).coeff(hanging, 1));
+	// The star follows later splits
+	mesh.SplitAlongXY(1, 0.5);
+	CHECK(mesh.getVertexStar().size() == mesh.getVertices().size());
+	CHECK(mesh.getVertexStar().cuboids(hanging).size() == 4);
+
+	Mesh random;
+	helpers::random_splits(random, 1000, 14);
+	const auto& random_star = random.getVertexStar();
+	bool same = true;
+	for (uint32_t v = 0; v < random.getVertices().size(); v++) {
+		std::vector<uint32_t> expected;
+		for (uint32_t c = 0; c < random.getCuboids().size(); c++) {
+			if (random.getBoxes()[c].contains(random.getVertices()[v])) expected.push_back(c);
+		}
+		same &= std::equal(expected.begin(), expected.end(), random_star.cuboids(v).begin(), random_star.cuboids(v).end());
+	}
+	CHECK(same);
+}
+
+TEST_CASE("The sparse incidence operator matches the matrix", "[IncidenceOperator]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 40, 15);
+	QuantitiesOfInterest q(mesh);
+	const auto incidence = q.VertexEdgeIncidenceOperator();
+	const MatrixXf dense = q.VertexEdgeIncidenceMatrix();
+	REQUIRE(incidence.rows() == q.getAllEdges().size());
+	REQUIRE(incidence.cols() == mesh.getVertices().size());
+	CHECK(MatrixXf(incidence.toSparse()).isApprox(dense));
+
+	Eigen::VectorXf x = Eigen::VectorXf::Random(incidence.cols());
+	Eigen::VectorXf y(incidence.rows());
+	incidence.apply({ x.data(), static_cast<size_t>(x.size()) }, { y.data(), static_cast<size_t>(y.size()) }, 4);
+	CHECK(y.isApprox(dense * x));
+	Eigen::VectorXf z = Eigen::VectorXf::Random(incidence.rows());
+	Eigen::VectorXf w(incidence.cols());
+	incidence.applyTranspose({ z.data(), static_cast<size_t>(z.size()) }, { w.data(), static_cast<size_t>(w.size()) }, 4);
+	CHECK(w.isApprox(dense.transpose() * z));
+	// Constant functions have no gradient
+	std::vector<float> ones(incidence.cols(), 1.0f), differences(incidence.rows());
+	incidence.apply(ones, differences);
+	CHECK(std::all_of(differences.begin(), differences.end(), [](float d) { return d == 0.0f; }));
+	// Every edge points away from the origin, so the x coordinates do not decrease along it
+	std::vector<float> xs(incidence.cols());
+	for (uint32_t v = 0; v < incidence.cols(); v++) xs[v] = mesh.getVertices()[v].x;
+	incidence.apply(xs, differences);
+	CHECK(std::all_of(differences.begin(), differences.end(), [](float d) { return d >= 0.0f; }));
+}
+
+TEST_CASE("The dual graph matches the adjacency of the cuboids", "[DualGraph]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 60, 21);
+	const auto& graph = mesh.getDualGraph();
+	const auto& boxes = mesh.getBoxes();
+	REQUIRE(graph.size() == mesh.getCuboids().size());
+	bool matches = true;
+	bool symmetric = true;
+	for (uint32_t a = 0; a < graph.size(); a++) {
+		for (uint32_t b = 0; b < graph.size(); b++) {
+			if (a == b) continue;
+			// Touching boxes share a face if they overlap in two axes and touch in the third
+			int overlapping = 0, touching = 0;
+			for (const Axis axis : { Axis::x, Axis::y, Axis::z }) {
+				const float lo = std::max(axisCoord(boxes[a].min, axis), axisCoord(boxes[b].min, axis));
+				const float hi = std::min(axisCoord(boxes[a].max, axis), axisCoord(boxes[b].max, axis));
+				if (lo < hi) overlapping++;
+				else if (lo == hi) touching++;
+			}
+			matches &= graph.adjacent(a, b) == (overlapping == 2 && touching == 1);
+			symmetric &= graph.sharedArea(a, b) == graph.sharedArea(b, a);
+		}
+	}
+	CHECK(matches);
+	CHECK(symmetric);
+	// Every interior face is counted from both sides, the border faces add up to the 6 faces of the unit cube
+	double total_area = 0.0;
+	for (const float area : graph.getWeights()) total_area += area;
+	double surface = 0.0;
+	for (const auto& box : boxes) {
+		const Vertex size = box.max - box.min;
+		surface += 2.0 * (size.x * size.y + size.y * size.z + size.x * size.z);
+	}
+	CHECK(total_area == Approx(surface - 6.0).epsilon(1e-4));
+
+	graph.writeMetis("dual_graph.graph");
+	std::ifstream in("dual_graph.graph");
+	size_t n, m;
+	std::string format;
+	in >> n >> m >> format;
+	CHECK(n == graph.size());
+	CHECK(m == graph.numEdges());
+	CHECK(format == "001");
+}
+
+TEST_CASE("Reorder cuboids and vertices along a space filling curve", "[Mesh]")
+{
+	SECTION("Consecutive cuboids of a uniform mesh are neighbours along the Hilbert curve") {
+		Mesh mesh(8, 8, 8);
+		mesh.Reorder(CurveOrder::hilbert);
+		const auto& graph = mesh.getDualGraph();
+		bool face_neighbours = true;
+		for (uint32_t c = 0; c + 1 < graph.size(); c++) face_neighbours &= graph.adjacent(c, c + 1);
+		CHECK(face_neighbours);
+		CHECK(SanityChecks::AllAdjacent(mesh));
+		CHECK(SanityChecks::ConsistentIds(mesh));
+	}
+	SECTION("The permutation maps the old mesh onto the new one") {
+		for (const auto order : { CurveOrder::morton, CurveOrder::hilbert }) {
+			Mesh mesh;
+			helpers::random_splits(mesh, 80, 33);
+			const std::vector<Box> boxes = mesh.getBoxes();
+			const std::vector<Cuboid> cuboids = mesh.getCuboids();
+			const auto permutation = mesh.Reorder(order, 4);
+			REQUIRE(permutation.cuboids.size() == boxes.size());
+			REQUIRE(permutation.vertices.size() == mesh.getVertices().size());
+			bool mapped = true;
+			for (uint32_t c = 0; c < boxes.size(); c++) {
+				const uint32_t to = permutation.cuboids[c];
+				mapped &= mesh.getBoxes()[to].min == boxes[c].min && mesh.getBoxes()[to].max == boxes[c].max;
+				for (uint8_t i = 0; i < 8; i++) mapped &= mesh.getCuboids()[to].vertices[i] == permutation.vertices[cuboids[c].vertices[i]];
+			}
+			CHECK(mapped);
+			CHECK(SanityChecks::AllAdjacent(mesh));
+			CHECK(SanityChecks::ConsistentIds(mesh));
+			// The renumbered mesh can be refined further
+			helpers::random_splits(mesh, 40, 34);
+			CHECK(SanityChecks::AllAdjacent(mesh));
+			CHECK(SanityChecks::ConsistentIds(mesh));
+		}
+	}
+}
+
+TEST_CASE("Validate finds no violations in consistent meshes and reports corruption", "[Mesh]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 300, 41);
+	mesh.Subdivide(0, 2, 3, 2);
+	// Merge some cuboids back, merged meshes have to stay valid as well
+	for (uint32_t cub = 0; cub < mesh.getCuboids().size(); cub += 7) {
+		const auto twin = mesh.Twin(halfFace(cub, 1));
+		if (!twin.isBorder() && !twin.isSubdivided()) mesh.Merge(cub, twin.getCuboid());
+	}
+	const auto report = mesh.Validate({ .num_threads = 4 });
+	CHECK(report.valid());
+	CHECK(report.violations.empty());
+
+	SECTION("A broken twin is reported") {
+		// Find an interior face and cut it off from its neighbour
+		uint32_t cub = 0;
+		while (mesh.Twin(halfFace(cub, 1)).isBorder()) cub++;
+		mesh.Twin(halfFace(cub, 1)) = halfFace(border_id);
+		const auto broken = mesh.Validate();
+		CHECK(!broken.valid());
+		CHECK(broken.count(MeshViolation::coverage) > 0);
+		CHECK(broken.count(MeshViolation::twin) > 0);
+		REQUIRE(!broken.violations.empty());
+		CHECK(broken.violations.front().kind == MeshViolation::twin);
+	}
+	SECTION("Only the first violations are stored") {
+		for (uint32_t cub = 0; cub < mesh.getCuboids().size(); cub++) mesh.Twin(halfFace(cub, 0)) = halfFace(border_id);
+		const auto broken = mesh.Validate({ .max_reported = 5 });
+		CHECK(broken.violations.size() == 5);
+		CHECK(broken.count(MeshViolation::coverage) > 5);
+	}
+}
+
+TEST_CASE("Marking strategies for adaptive refinement", "[AdaptiveRefinement]")
+{
+	const std::vector<double> errors = { 0.1, 0.4, 0.0, 0.3, 0.2 };
+	AdaptiveOptions options;
+	options.strategy = MarkingStrategy::maximum;
+	options.theta = 0.5;
+	CHECK(markCuboids(errors, options) == std::vector<uint32_t>{ 1, 3, 4 });
+	options.strategy = MarkingStrategy::dorfler;
+	CHECK(markCuboids(errors, options) == std::vector<uint32_t>{ 1, 3 });
+	options.strategy = MarkingStrategy::fixed_count;
+	options.count = 2;
+	CHECK(markCuboids(errors, options) == std::vector<uint32_t>{ 1, 3 });
+	options.count = 10;
+	CHECK(markCuboids(errors, options).size() == 4);
+
+	Mesh mesh;
+	mesh.SplitAlongYZ(0, 0.75);
+	mesh.SplitAlongXZ(0, 0.5);
+	mesh.SplitAlongXY(0, 0.5);
+	const auto longest = bisectLongestSide(mesh, 0);
+	CHECK(longest.axis == Axis::x);
+	CHECK(longest.coordinate == Approx(0.375));
+}
+
+TEST_CASE("Adaptive refinement towards a point", "[AdaptiveRefinement]")
+{
+	// The error of a cuboid is its volume if it contains the point, so refinement concentrates around it
+	const Vertex point = { 0.3f, 0.6f, 0.2f };
+	std::atomic<size_t> evaluations = 0;
+	const auto indicator = [&](const Mesh& mesh, uint32_t cuboid) {
+		evaluations++;
+		const Box& box = mesh.getBoxes()[cuboid];
+		const Vertex size = box.max - box.min;
+		return box.contains(point) ? static_cast<double>(size.x) * size.y * size.z : 0.0;
+	};
+	SECTION("Stop at the tolerance") {
+		Mesh mesh;
+		AdaptiveOptions options;
+		options.tolerance = 1e-4;
+		const auto result = refineAdaptively(mesh, indicator, options);
+		CHECK(result.reason == AdaptiveStop::tolerance);
+		CHECK(result.error <= 1e-4);
+		// Unchanged cuboids are not evaluated again, every split evaluates the two halves
+		CHECK(evaluations == 1 + 2 * (mesh.getCuboids().size() - 1));
+		CHECK(SanityChecks::AllAdjacent(mesh));
+		CHECK(mesh.Validate().valid());
+	}
+	SECTION("Stop at the element budget") {
+		Mesh mesh(4, 4, 4);
+		AdaptiveOptions options;
+		options.strategy = MarkingStrategy::fixed_count;
+		options.count = 5;
+		options.max_cuboids = 100;
+		const auto result = refineAdaptively(mesh, [](const Mesh& mesh, uint32_t cuboid) {
+			const Box& box = mesh.getBoxes()[cuboid];
+			return static_cast<double>(box.max.x - box.min.x);
+		}, options);
+		CHECK(result.reason == AdaptiveStop::budget);
+		CHECK(mesh.getCuboids().size() == 100);
+		CHECK(mesh.Validate().valid());
+	}
+	SECTION("The indicator reads the neighbours on several threads") {
+		// Enough cuboids for several chunks of the parallel evaluation
+		Mesh mesh(8, 8, 8);
+		AdaptiveOptions options;
+		options.tolerance = 1e-4;
+		options.num_threads = 4;
+		std::atomic<bool> consistent = true;
+		const auto result = refineAdaptively(mesh, [&](const Mesh& mesh, uint32_t cuboid) {
+			// The dual graph, the vertex star and Adjacent all describe the same neighbours
+			for (const uint32_t neighbour : mesh.getDualGraph().neighbours(cuboid)) {
+				if (!mesh.Adjacent(cuboid, neighbour)) consistent = false;
+			}
+			for (const uint32_t v : mesh.getCuboids()[cuboid].vertices) {
+				if (!contains(mesh.getVertexStar().cuboids(v), cuboid)) consistent = false;
+			}
+			return indicator(mesh, cuboid);
+		}, options);
+		CHECK(result.reason == AdaptiveStop::tolerance);
+		CHECK(consistent);
+		CHECK(mesh.Validate().valid());
+	}
+}
+
+namespace helpers {
+	/*
+	* Largest ratio between the sides of face neighbours along their common face
+	*/
+	float max_grading_ratio(const Mesh& mesh) {
+		const auto& graph = mesh.getDualGraph();
+		const auto& boxes = mesh.getBoxes();
+		float ratio = 1.0f;
+		for (uint32_t a = 0; a < graph.size(); a++) {
+			for (const uint32_t b : graph.neighbours(a)) {
+				for (const Axis axis : { Axis::x, Axis::y, Axis::z }) {
+					// The normal of the common face is the axis along which the boxes only touch
+					const float overlap = std::min(axisCoord(boxes[a].max, axis), axisCoord(boxes[b].max, axis)) - std::max(axisCoord(boxes[a].min, axis), axisCoord(boxes[b].min, axis));
+					if (overlap <= 0.0f) continue;
+					ratio = std::max(ratio, (axisCoord(boxes[b].max, axis) - axisCoord(boxes[b].min, axis)) / (axisCoord(boxes[a].max, axis) - axisCoord(boxes[a].min, axis)));
+				}
+			}
+		}
+		return ratio;
+	}
+}
+
+TEST_CASE("Balance the mesh to a 2:1 grading", "[Mesh]")
+{
+	Mesh mesh;
+	// Cut thin slabs off the corner cuboid along x and then along y, the slabs are much longer along y than the corner
+	for (int i = 0; i < 5; i++) mesh.SplitAlongYZ(0, mesh.getBoxes()[0].center().x);
+	for (int i = 0; i < 5; i++) mesh.SplitAlongXZ(0, mesh.getBoxes()[0].center().y);
+	REQUIRE(helpers::max_grading_ratio(mesh) > 2.0f);
+	const auto changed = mesh.Balance(2.0f);
+	CHECK(!changed.empty());
+	CHECK(std::is_sorted(changed.begin(), changed.end()));
+	CHECK(helpers::max_grading_ratio(mesh) <= 2.0f);
+	CHECK(mesh.Validate().valid());
+	// A balanced mesh stays as it is
+	const size_t num_cuboids = mesh.getCuboids().size();
+	CHECK(mesh.Balance(2.0f).empty());
+	CHECK(mesh.getCuboids().size() == num_cuboids);
+
+	SECTION("Adaptive refinement with balancing") {
+		Mesh adaptive;
+		AdaptiveOptions options;
+		options.max_ratio = 2.0f;
+		options.tolerance = 1e-5;
+		const Vertex point = { 0.1f, 0.7f, 0.4f };
+		refineAdaptively(adaptive, [&](const Mesh& mesh, uint32_t cuboid) {
+			const Box& box = mesh.getBoxes()[cuboid];
+			const Vertex size = box.max - box.min;
+			return box.contains(point) ? static_cast<double>(size.x) * size.y * size.z : 0.0;
+		}, options);
+		CHECK(helpers::max_grading_ratio(adaptive) <= 2.0f);
+		CHECK(adaptive.Validate().valid());
+	}
+}
+
+TEST_CASE("The refinement history records splits and merges", "[RefinementHistory]")
+{
+	Mesh mesh;
+	mesh.EnableHistory();
+	const uint32_t top = mesh.SplitAlongYZ(0, 0.5);
+	const auto quarters = mesh.Subdivide(top, 1, 2, 2);
+	const auto& history = mesh.getHistory();
+	// The history started with one cuboid, its root is the first node
+	const uint32_t root = 0;
+	REQUIRE(history.roots() == std::vector<uint32_t>{ root });
+	CHECK(history[root].axis == Axis::x);
+	CHECK(history[root].coordinate == 0.5f);
+	CHECK(history.depth() == 3);
+	CHECK(history.level(1).size() == 2);
+	// The top half was split into four quarters, all of them descend from its node
+	const uint32_t top_node = history[root].first_child + 1;
+	auto descendants = history.cuboids(top_node);
+	std::sort(descendants.begin(), descendants.end());
+	auto expected = quarters;
+	std::sort(expected.begin(), expected.end());
+	CHECK(descendants == expected);
+	bool ancestors = true;
+	for (const auto quarter : quarters) {
+		ancestors &= history.isAncestor(top_node, history.leaf(quarter)) && history.ancestor(history.leaf(quarter), 1) == top_node;
+		ancestors &= history[history.leaf(quarter)].cuboid == quarter;
+	}
+	CHECK(ancestors);
+	CHECK(!history.isAncestor(top_node, history.leaf(0)));
+	CHECK(history.cuboids(root).size() == mesh.getCuboids().size());
+
+	SECTION("Merging siblings restores their parent") {
+		const uint32_t quarter_node = history.leaf(quarters[1]);
+		const uint32_t parent = history[quarter_node].parent;
+		const uint32_t sibling = history[history[parent].first_child].cuboid == quarters[1] ? history[history[parent].first_child + 1].cuboid : history[history[parent].first_child].cuboid;
+		const uint32_t merged = mesh.Merge(quarters[1], sibling).cuboid;
+		REQUIRE(merged != static_cast<uint32_t>(-1));
+		CHECK(history.leaf(merged) == parent);
+		CHECK(history[parent].isLeaf());
+		// Every cuboid is still a leaf of the history and only once
+		std::vector<uint32_t> all = history.cuboids(root);
+		std::sort(all.begin(), all.end());
+		std::vector<uint32_t> ids(mesh.getCuboids().size());
+		std::iota(ids.begin(), ids.end(), 0);
+		CHECK(all == ids);
+	}
+	SECTION("Reordering keeps the history") {
+		const auto permutation = mesh.Reorder();
+		bool renumbered = true;
+		for (uint32_t c = 0; c < mesh.getCuboids().size(); c++) renumbered &= history[history.leaf(c)].cuboid == c;
+		CHECK(renumbered);
+		CHECK(history.cuboids(root).size() == mesh.getCuboids().size());
+	}
+}
+
+TEST_CASE("Threaded leaves iterate in the same order as the tree", "[SubFaceTree]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 300, 51);
+	mesh.prepareForConcurrentReads();
+	const auto& sft = mesh.getSft();
+	const auto in_order = [&]() {
+		bool same_order = true;
+		size_t num_trees = 0;
+		for (const auto twin : mesh.getF2f()) {
+			if (!twin.isSubdivided()) continue;
+			num_trees++;
+			// The leaves in depth first order, lower children first
+			std::vector<halfFace> expected;
+			std::vector<halfFace> stack = { twin };
+			while (!stack.empty()) {
+				const halfFace hf = stack.back();
+				stack.pop_back();
+				if (!hf.isSubdivided()) {
+					expected.push_back(hf);
+					continue;
+				}
+				stack.push_back(sft.nodes[SubFaceTree::toNodeIndex(hf)].top_child);
+				stack.push_back(sft.nodes[SubFaceTree::toNodeIndex(hf)].lower_child);
+			}
+			std::vector<halfFace> iterated;
+			for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) iterated.push_back(*it);
+			same_order &= iterated == expected;
+		}
+		return num_trees > 0 && same_order;
+	};
+	CHECK(sft.isThreaded());
+	CHECK(in_order());
+	// A single split only records the changed trees, iterators climb them until they are threaded again
+	mesh.SplitAlongXY(0, mesh.getBoxes()[0].center().z);
+	CHECK(!sft.isThreaded());
+	CHECK(in_order());
+	mesh.prepareForConcurrentReads();
+	CHECK(sft.isThreaded());
+	CHECK(in_order());
+	std::mt19937 random_engine(51);
+	for (int i = 0; i < 200; ++i) {
+		std::uniform_int_distribution<uint32_t> distribution(0, mesh.getCuboids().size() - 1);
+		const uint32_t cub = distribution(random_engine);
+		for (uint8_t face = 0; face < 6; face++) {
+			const auto twin = mesh.Twin(halfFace(cub, face));
+			if (twin.isBorder() || twin.isSubdivided()) continue;
+			if (mesh.Merge(cub, twin.getCuboid()).merged()) break;
+		}
+	}
+	mesh.prepareForConcurrentReads();
+	CHECK(sft.isThreaded());
+	CHECK(in_order());
+	mesh.CompactSubFaceTrees();
+	CHECK(sft.isThreaded());
+	CHECK(in_order());
+	// Batches thread the trees at their end
+	std::vector<SplitRequest> requests;
+	for (uint32_t cub = 0; cub < 50; cub++) requests.push_back({ cub, Axis::y, mesh.getBoxes()[cub].center().y });
+	mesh.SplitParallel(requests, 1);
+	CHECK(sft.isThreaded());
+	CHECK(in_order());
+}
+
+TEST_CASE("Compacting the subface trees drops the free nodes", "[SubFaceTree]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 300, 52);
+	std::mt19937 random_engine(52);
+	for (int i = 0; i < 1000 && mesh.getCuboids().size() > 1; ++i) {
+		std::uniform_int_distribution<uint32_t> distribution(0, mesh.getCuboids().size() - 1);
+		const uint32_t cub = distribution(random_engine);
+		for (uint8_t face = 0; face < 6; face++) {
+			const auto twin = mesh.Twin(halfFace(cub, face));
+			if (twin.isBorder() || twin.isSubdivided()) continue;
+			if (mesh.Merge(cub, twin.getCuboid()).merged()) break;
+		}
+	}
+	const size_t num_nodes = mesh.getSft().nodes.size();
+	const size_t num_free = mesh.getSft().numFreeNodes();
+	CHECK(num_free > 0);
+	mesh.CompactSubFaceTrees();
+	CHECK(mesh.getSft().numFreeNodes() == 0);
+	CHECK(mesh.getSft().nodes.size() == num_nodes - num_free);
+	// Every tree is stored contiguously, its head first
+	bool contiguous = true;
+	for (const auto twin : mesh.getF2f()) {
+		if (!twin.isSubdivided()) continue;
+		std::vector<uint32_t> tree;
+		std::vector<halfFace> stack = { twin };
+		while (!stack.empty()) {
+			const halfFace hf = stack.back();
+			stack.pop_back();
+			if (!hf.isSubdivided()) continue;
+			tree.push_back(SubFaceTree::toNodeIndex(hf));
+			stack.push_back(mesh.getSft().nodes[tree.back()].top_child);
+			stack.push_back(mesh.getSft().nodes[tree.back()].lower_child);
+		}
+		for (size_t i = 0; i < tree.size(); i++) contiguous &= tree[i] == tree[0] + i;
+	}
+	CHECK(contiguous);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+	CHECK(mesh.Validate().valid());
+	// The compacted trees can be split and merged again
+	helpers::random_splits(mesh, 100, 53);
+	CHECK(SanityChecks::AllAdjacent(mesh));
+	CHECK(mesh.Validate().valid());
+}
+
+TEST_CASE("Batched point location finds the same leaves as single queries", "[SubFaceTree]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 500, 54);
+	const auto& sft = mesh.getSft();
+	std::vector<halfFace> roots;
+	std::vector<Vertex> points;
+	// The corners of every cuboid located in the trees of its faces, unsubdivided faces are copied through
+	for (uint32_t cub = 0; cub < mesh.getCuboids().size(); cub++) {
+		for (uint8_t face = 0; face < 6; face++) {
+			const auto twin = mesh.Twin(halfFace(cub, face));
+			if (twin.isBorder()) continue;
+			for (const uint8_t lv : Hf2Ve[face]) {
+				roots.push_back(twin);
+				points.push_back(mesh.getVertices()[mesh.getCuboids()[cub].vertices[lv]]);
+			}
+		}
+	}
+	std::vector<halfFace> found(roots.size(), halfFace(border_id));
+	sft.find(roots, points, found);
+	bool same = true;
+	size_t subdivided = 0;
+	for (size_t i = 0; i < roots.size(); i++) {
+		if (!roots[i].isSubdivided()) {
+			same &= found[i] == roots[i];
+			continue;
+		}
+		subdivided++;
+		same &= found[i] == *sft.find(roots[i], points[i]);
+	}
+	CHECK(subdivided > 100);
+	CHECK(same);
+}
+
+TEST_CASE("A rectangle query visits the subfaces overlapping the rectangle", "[SubFaceTree]")
+{
+	Mesh mesh;
+	helpers::random_splits(mesh, 500, 55);
+	const auto& sft = mesh.getSft();
+	std::mt19937 random_engine(55);
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	const auto overlap = [](float min_a, float max_a, float min_b, float max_b) { return min_a + eps <= max_b && min_b + eps <= max_a; };
+	bool same = true;
+	size_t num_trees = 0, skipped = 0;
+	for (uint32_t f = 0; f < mesh.getF2f().size(); f++) {
+		const auto twin = mesh.getF2f()[f];
+		if (!twin.isSubdivided()) continue;
+		num_trees++;
+		const Axis normal = Hf2Ax[f % 6];
+		// A random rectangle inside the face, its extent along the normal is ignored
+		const Box& face_box = mesh.getBoxes()[f / 6];
+		Box rect = face_box;
+		for (const Axis a : { Axis::x, Axis::y, Axis::z }) {
+			if (a == normal) continue;
+			const float lo = axisCoord(face_box.min, a), size = axisCoord(face_box.max, a) - lo;
+			const float t1 = distribution(random_engine), t2 = distribution(random_engine);
+			axisCoord(rect.min, a) = lo + size * std::min(t1, t2);
+			axisCoord(rect.max, a) = lo + size * std::max(t1, t2);
+		}
+		std::vector<halfFace> expected, queried;
+		size_t leaves = 0;
+		for (auto it = sft.cbegin(twin); it != sft.cend(); ++it) {
+			leaves++;
+			const Box& leaf = mesh.getBoxes()[(*it).getCuboid()];
+			bool inside = true;
+			for (const Axis a : { Axis::x, Axis::y, Axis::z }) {
+				if (a != normal) inside &= overlap(axisCoord(leaf.min, a), axisCoord(leaf.max, a), axisCoord(rect.min, a), axisCoord(rect.max, a));
+			}
+			if (inside) expected.push_back(*it);
+		}
+		sft.query(twin, rect, [&](const halfFace hf) { queried.push_back(hf); });
+		same &= queried == expected;
+		skipped += leaves - queried.size();
+	}
+	CHECK(num_trees > 0);
+	CHECK(skipped > 0);
+	CHECK(same);
+}
+
+TEST_CASE("A subface tree node packs its split coordinate and axis", "[SubFaceTree]")
+{
+	const halfFace none(border_id);
+	for (const Axis axis : { Axis::x, Axis::y, Axis::z }) {
+		const Node node(none, 0.375f, axis, none, none);
+		CHECK(node.getSplitAxis() == axis);
+		CHECK(node.getSplitCoord() == 0.375f);
+		// The sign bit of -0.0f must not leak into the axis
+		const Node zero(none, -0.0f, axis, none, none);
+		CHECK(zero.getSplitAxis() == axis);
+		CHECK(zero.getSplitCoord() == 0.0f);
+	}
+}